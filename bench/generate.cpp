@@ -0,0 +1,190 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+// Generates the synthetic programs and dumps of the benchmark suite
+//---------------------------------------------------------------------------
+static void writeFunction(const string& name,unsigned statements)
+   // A function with one statement per line
+{
+   cout << "void " << name << "(void)" << endl << "{" << endl;
+   for (unsigned index=0;index<statements;index++)
+      cout << "   sink+=" << index << ";" << endl;
+   cout << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genLines(unsigned functions,unsigned statements)
+   // Many lines, each executed once
+{
+   cout << "volatile int sink;" << endl;
+   for (unsigned index=0;index<functions;index++) {
+      char name[30];
+      snprintf(name,sizeof(name),"f%u",index);
+      writeFunction(name,statements);
+   }
+   cout << "int main()" << endl << "{" << endl;
+   for (unsigned index=0;index<functions;index++)
+      cout << "   f" << index << "();" << endl;
+   cout << "   return 0;" << endl << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genThreads(unsigned threads,unsigned functions)
+   // Many threads racing for the same breakpoints
+{
+   cout << "#include <pthread.h>" << endl
+        << "volatile int sink;" << endl;
+   for (unsigned index=0;index<functions;index++) {
+      char name[30];
+      snprintf(name,sizeof(name),"f%u",index);
+      writeFunction(name,10);
+   }
+   cout << "static void* worker(void* arg)" << endl << "{" << endl
+        << "   for (int round=0;round<10;round++) {" << endl;
+   for (unsigned index=0;index<functions;index++)
+      cout << "      f" << index << "();" << endl;
+   cout << "   }" << endl << "   return arg;" << endl << "}" << endl
+        << "int main()" << endl << "{" << endl
+        << "   pthread_t threads[" << threads << "];" << endl
+        << "   for (int index=0;index<" << threads << ";index++)" << endl
+        << "      pthread_create(&threads[index],0,worker,0);" << endl
+        << "   for (int index=0;index<" << threads << ";index++)" << endl
+        << "      pthread_join(threads[index],0);" << endl
+        << "   return 0;" << endl << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genLibrary(unsigned library,unsigned functions)
+   // One of many shared libraries
+{
+   cout << "volatile int sink;" << endl;
+   for (unsigned index=0;index<functions;index++) {
+      char name[40];
+      snprintf(name,sizeof(name),"lib%u_f%u",library,index);
+      writeFunction(name,20);
+   }
+   cout << "void lib" << library << "_run(void)" << endl << "{" << endl;
+   for (unsigned index=0;index<functions;index++)
+      cout << "   lib" << library << "_f" << index << "();" << endl;
+   cout << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genLibraryMain(unsigned libraries)
+   // The program using all libraries
+{
+   for (unsigned index=0;index<libraries;index++)
+      cout << "void lib" << index << "_run(void);" << endl;
+   cout << "int main()" << endl << "{" << endl;
+   for (unsigned index=0;index<libraries;index++)
+      cout << "   lib" << index << "_run();" << endl;
+   cout << "   return 0;" << endl << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genHotLoop(unsigned iterations)
+   // A few lines executed very often
+{
+   cout << "volatile int sink;" << endl
+        << "int main()" << endl << "{" << endl
+        << "   for (unsigned index=0;index<" << iterations << "u;index++) {" << endl
+        << "      if (index&1)" << endl
+        << "         sink+=index;" << endl
+        << "      else" << endl
+        << "         sink-=index;" << endl
+        << "   }" << endl
+        << "   return 0;" << endl << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genInputs(unsigned functions)
+   // A program taking a different path for each input, for the fork server
+{
+   cout << "#include <stdio.h>" << endl
+        << "volatile int sink;" << endl;
+   for (unsigned index=0;index<functions;index++) {
+      char name[30];
+      snprintf(name,sizeof(name),"f%u",index);
+      writeFunction(name,10);
+   }
+   cout << "int main()" << endl << "{" << endl
+        << "   unsigned input=0;" << endl
+        << "   if (scanf(\"%u\",&input)!=1) return 1;" << endl
+        << "   switch (input%" << functions << ") {" << endl;
+   for (unsigned index=0;index<functions;index++)
+      cout << "      case " << index << ": f" << index << "(); break;" << endl;
+   cout << "   }" << endl << "   return 0;" << endl << "}" << endl;
+}
+//---------------------------------------------------------------------------
+static void genDump(unsigned files,unsigned lines)
+   // A dump with many source files in 100 files per directory
+{
+   cout << "command bench" << endl
+        << "args" << endl
+        << "date synthetic" << endl;
+   for (unsigned index=0;index<files;index++) {
+      cout << "file /bench/dir" << (index/100) << "/file" << index << ".c" << endl;
+      for (unsigned line=1;line<=lines;line++) {
+         unsigned possible=1+(line%3);
+         cout << line << " " << possible << " " << (((line+index)%4)?possible:0) << endl;
+      }
+   }
+}
+//---------------------------------------------------------------------------
+static void showHelp(const char* argv0)
+   // Show the help
+{
+   cout << "usage: " << argv0 << " lines <functions> <statements>" << endl
+        << "       " << argv0 << " threads <threads> <functions>" << endl
+        << "       " << argv0 << " library <index> <functions>" << endl
+        << "       " << argv0 << " libmain <libraries>" << endl
+        << "       " << argv0 << " hotloop <iterations>" << endl
+        << "       " << argv0 << " inputs <functions>" << endl
+        << "       " << argv0 << " dump <files> <lines>" << endl
+        << endl
+        << "writes the generated C program or dump to stdout" << endl;
+}
+//---------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+   if (argc<3) {
+      showHelp(argv[0]);
+      return 1;
+   }
+   string mode=argv[1];
+   unsigned first=strtoul(argv[2],0,10),second=(argc>3)?strtoul(argv[3],0,10):0;
+   if ((mode=="lines")&&(argc>3))
+      genLines(first,second);
+   else if ((mode=="threads")&&(argc>3))
+      genThreads(first,second);
+   else if ((mode=="library")&&(argc>3))
+      genLibrary(first,second);
+   else if (mode=="libmain")
+      genLibraryMain(first);
+   else if (mode=="hotloop")
+      genHotLoop(first);
+   else if (mode=="inputs")
+      genInputs(first);
+   else if ((mode=="dump")&&(argc>3))
+      genDump(first,second);
+   else {
+      showHelp(argv[0]);
+      return 1;
+   }
+   return 0;
+}
+//---------------------------------------------------------------------------
@@ -0,0 +1,121 @@
+#!/bin/sh
+# The bcov benchmark suite, usually started by make bench
+#
+# usage: run.sh bcov bcov-report generator [work directory]
+#
+# Builds synthetic programs and dumps in the work directory, measures
+# tracer startup, the overhead per hit against a native run and the
+# time and memory of bcov-report, and writes them to results.txt.
+# If bench/baseline.txt exists every result is compared against it.
+set -e
+
+BCOV=$1
+REPORT=$2
+GEN=$3
+WORK=${4:-bench-work}
+CC=${CC:-cc}
+BASELINE=${BASELINE:-`dirname $0`/baseline.txt}
+if [ -z "$GEN" ]; then
+   echo "usage: $0 bcov bcov-report generator [work directory]" >&2
+   exit 1
+fi
+case $BCOV in /*) ;; *) BCOV=`pwd`/$BCOV ;; esac
+case $REPORT in /*) ;; *) REPORT=`pwd`/$REPORT ;; esac
+case $GEN in /*) ;; *) GEN=`pwd`/$GEN ;; esac
+mkdir -p $WORK
+cd $WORK
+RESULTS=results.txt
+: > $RESULTS
+TIME=
+if /usr/bin/time -f %M true >/dev/null 2>&1; then TIME=/usr/bin/time; fi
+
+# Time a command in microseconds
+now() { date +%s%N; }
+elapsed() { echo $(( (`now` - $1) / 1000 )); }
+
+# Record a result, compared against the baseline if there is one
+record() {
+   echo "$1 $2 $3" >> $RESULTS
+   old=
+   if [ -f "$BASELINE" ]; then old=`awk -v n="$1" '$1==n {print $2}' "$BASELINE"`; fi
+   if [ -n "$old" ] && [ "$old" -gt 0 ]; then
+      awk -v n="$1" -v v="$2" -v u="$3" -v o="$old" 'BEGIN { printf "%-28s %12d %-3s (%.2fx baseline)\n",n,v,u,v/o }'
+   else
+      printf "%-28s %12d %s\n" "$1" "$2" "$3"
+   fi
+}
+
+# A value from the --stats-json output
+stat() { sed -n "s/.*\"$2\": \([0-9]*\).*/\1/p" $1 | head -1; }
+
+# Run a program natively and under bcov: total time, startup and overhead per hit
+traced() {
+   name=$1; shift
+   start=`now`; "$@" >/dev/null 2>&1; native=`elapsed $start`
+   start=`now`
+   if ! $BCOV --stats-json $name.json -o $name.bcovdump $BCOV_ARGS "$@" >/dev/null 2>&1; then
+      echo "$name: bcov failed" >&2
+      return
+   fi
+   total=`elapsed $start`
+   startup=$(( (`stat $name.json load` + `stat $name.json dwarf` + `stat $name.json breakpoints`) / 1000 ))
+   run=$(( `stat $name.json run` / 1000 ))
+   traps=`stat $name.json traps`
+   record $name.native $native us
+   record $name.bcov $total us
+   record $name.startup $startup us
+   record $name.traps $traps hits
+   if [ "$traps" -gt 0 ]; then
+      record $name.per-hit $(( (run - native) * 1000 / traps )) ns
+   fi
+}
+
+echo "generating programs..."
+$GEN lines 2000 100 > lines.c && $CC -g -O0 -o lines lines.c
+$GEN threads 32 200 > threads.c && $CC -g -O0 -pthread -o threads threads.c
+$GEN hotloop 100000000 > hotloop.c && $CC -g -O0 -o hotloop hotloop.c
+LIBS=
+LIBARGS=
+for index in `seq 0 49`; do
+   $GEN library $index 50 > lib$index.c
+   $CC -g -O0 -shared -fPIC -o libbench$index.so lib$index.c
+   LIBS="$LIBS -lbench$index"
+   LIBARGS="$LIBARGS -l `pwd`/libbench$index.so"
+done
+$GEN libmain 50 > libmain.c && $CC -g -O0 -o libmain libmain.c -L. $LIBS
+$GEN inputs 100 > inputs.c && $CC -g -O0 -o inputs inputs.c
+: > inputs.txt
+for index in `seq 1 500`; do echo $index > input$index; echo `pwd`/input$index >> inputs.txt; done
+echo "generating dumps..."
+$GEN dump 100000 20 > report.bcovdump
+
+echo "running..."
+traced lines ./lines
+traced threads ./threads
+traced hotloop ./hotloop
+LD_LIBRARY_PATH=`pwd`; export LD_LIBRARY_PATH
+BCOV_ARGS=$LIBARGS
+traced libraries ./libmain
+BCOV_ARGS=
+start=`now`
+if $BCOV -o inputs.bcovdump -F inputs.txt ./inputs >/dev/null 2>&1; then
+   record fork-server.per-input $(( `elapsed $start` / 500 )) us
+else
+   echo "fork-server: bcov failed" >&2
+fi
+
+rm -rf report && mkdir report
+start=`now`
+if [ -n "$TIME" ]; then
+   status=0; $TIME -f %M -o report.rss $REPORT report.bcovdump report >/dev/null 2>&1 || status=$?
+else
+   status=0; $REPORT report.bcovdump report >/dev/null 2>&1 || status=$?
+fi
+if [ $status -ne 0 ]; then
+   echo "report: bcov-report failed with status $status" >&2
+   exit 1
+fi
+record report.time `elapsed $start` us
+if [ -n "$TIME" ]; then record report.rss `cat report.rss` kB; fi
+
+echo "results written to `pwd`/$RESULTS"
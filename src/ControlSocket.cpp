@@ -0,0 +1,221 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "ControlSocket.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// How long we wait for a client to send its commands
+static const int clientTimeout = 1000;
+//---------------------------------------------------------------------------
+ControlSocket::ControlSocket()
+   : fd(-1)
+   // Constructor
+{
+}
+//---------------------------------------------------------------------------
+ControlSocket::~ControlSocket()
+   // Destructor
+{
+   close();
+}
+//---------------------------------------------------------------------------
+bool ControlSocket::open(const string& path)
+   // Create the socket
+{
+   close();
+
+   sockaddr_un addr;
+   memset(&addr,0,sizeof(addr));
+   addr.sun_family=AF_UNIX;
+   if (path.length()>=sizeof(addr.sun_path)) {
+      cerr << "socket path too long: " << path << endl;
+      return false;
+   }
+   strcpy(addr.sun_path,path.c_str());
+
+   if ((fd=socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0))<0) {
+      perror("socket");
+      return false;
+   }
+   unlink(path.c_str());
+   if ((bind(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0)||(listen(fd,16)!=0)) {
+      cerr << "unable to listen on " << path << ": " << strerror(errno) << endl;
+      ::close(fd);
+      fd=-1;
+      return false;
+   }
+   this->path=path;
+   return true;
+}
+//---------------------------------------------------------------------------
+void ControlSocket::close()
+   // Close and remove the socket
+{
+   if (fd>=0) {
+      ::close(fd);
+      unlink(path.c_str());
+      fd=-1;
+   }
+}
+//---------------------------------------------------------------------------
+int ControlSocket::acceptClient()
+   // Accept a client. Its descriptor is non-blocking, so reading never stalls the caller
+{
+   return accept4(fd,0,0,SOCK_NONBLOCK|SOCK_CLOEXEC);
+}
+//---------------------------------------------------------------------------
+static void addCommand(vector<string>& commands,const string& line)
+   // Add a command line without trailing blanks, empty lines are ignored
+{
+   string::size_type last=line.find_last_not_of("\r \t");
+   if (last!=string::npos)
+      commands.push_back(line.substr(0,last+1));
+}
+//---------------------------------------------------------------------------
+bool ControlSocket::readCommands(int client,string& input,vector<string>& commands)
+   // Read what a client sent so far. A partial line waits for the rest, unless the client closed its side
+{
+   bool open=true;
+   while (true) {
+      char buffer[1024];
+      ssize_t len=read(client,buffer,sizeof(buffer));
+      if (len>0) {
+         input.append(buffer,len);
+         continue;
+      }
+      if ((len<0)&&(errno==EINTR))
+         continue;
+      open=(len<0)&&((errno==EAGAIN)||(errno==EWOULDBLOCK));
+      break;
+   }
+
+   // Split off the complete lines
+   string::size_type start=0;
+   for (string::size_type end;(end=input.find('\n',start))!=string::npos;start=end+1)
+      addCommand(commands,input.substr(start,end-start));
+   input.erase(0,start);
+   if (!open) {
+      addCommand(commands,input);
+      input.clear();
+   }
+   return open;
+}
+//---------------------------------------------------------------------------
+int ControlSocket::receive(vector<string>& commands)
+   // Accept a client and read its commands
+{
+   commands.clear();
+   int client=acceptClient();
+   if (client<0)
+      return -1;
+
+   // Read until the client shuts down its side, or stops talking
+   string input;
+   while (true) {
+      pollfd p;
+      p.fd=client; p.events=POLLIN;
+      if (poll(&p,1,clientTimeout)<=0)
+         break;
+      if (!readCommands(client,input,commands))
+         break;
+      // Complete commands are enough if nothing else is pending
+      p.revents=0;
+      if ((!commands.empty())&&input.empty()&&(poll(&p,1,0)==0))
+         break;
+   }
+   addCommand(commands,input);
+   return client;
+}
+//---------------------------------------------------------------------------
+void ControlSocket::reply(int client,const string& text)
+   // Send a reply to a client
+{
+   string line=text+"\n";
+   const char* pos=line.c_str();
+   for (size_t left=line.length();left;) {
+      ssize_t len=send(client,pos,left,MSG_NOSIGNAL);
+      if ((len<0)&&((errno==EINTR)||(errno==EAGAIN)||(errno==EWOULDBLOCK))) {
+         // A non-blocking client with a full buffer, give it some time
+         pollfd p;
+         p.fd=client; p.events=POLLOUT;
+         if ((errno==EINTR)||(poll(&p,1,clientTimeout)>0))
+            continue;
+      }
+      if (len<=0) break;
+      pos+=len; left-=len;
+   }
+}
+//---------------------------------------------------------------------------
+void ControlSocket::finish(int client)
+   // Close a client connection
+{
+   ::close(client);
+}
+//---------------------------------------------------------------------------
+bool ControlSocket::request(const string& path,const vector<string>& commands,vector<string>& replies)
+   // Connect to a socket, send commands and collect the reply lines until the other side closes
+{
+   replies.clear();
+   sockaddr_un addr;
+   memset(&addr,0,sizeof(addr));
+   addr.sun_family=AF_UNIX;
+   if (path.length()>=sizeof(addr.sun_path)) {
+      cerr << "socket path too long: " << path << endl;
+      return false;
+   }
+   strcpy(addr.sun_path,path.c_str());
+   int client=socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+   if (client<0) {
+      perror("socket");
+      return false;
+   }
+   if (connect(client,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0) {
+      cerr << "unable to connect to " << path << ": " << strerror(errno) << endl;
+      ::close(client);
+      return false;
+   }
+   for (vector<string>::const_iterator iter=commands.begin(),limit=commands.end();iter!=limit;++iter)
+      reply(client,*iter);
+   shutdown(client,SHUT_WR);
+
+   // The replies may take long, e.g. while a report is written
+   string data;
+   char buffer[1024];
+   for (ssize_t len;(len=read(client,buffer,sizeof(buffer)))!=0;) {
+      if (len<0) {
+         if (errno==EINTR) continue;
+         break;
+      }
+      data.append(buffer,len);
+   }
+   ::close(client);
+   for (string::size_type start=0;start<data.length();) {
+      string::size_type end=data.find('\n',start);
+      if (end==string::npos) end=data.length();
+      replies.push_back(data.substr(start,end-start));
+      start=end+1;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
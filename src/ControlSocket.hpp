@@ -0,0 +1,43 @@
+#ifndef H_ControlSocket
+#define H_ControlSocket
+//---------------------------------------------------------------------------
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+/// A unix domain socket accepting line based control commands
+class ControlSocket
+{
+   private:
+   /// The listening socket
+   int fd;
+   /// The socket path
+   std::string path;
+
+   public:
+   /// Constructor
+   ControlSocket();
+   /// Destructor
+   ~ControlSocket();
+
+   /// Create the socket
+   bool open(const std::string& path);
+   /// Close and remove the socket
+   void close();
+   /// The listening descriptor, readable when a client connects
+   int getFd() const { return fd; }
+
+   /// Accept a client. Its descriptor is non-blocking. Returns the client or -1
+   int acceptClient();
+   /// Read what a client sent so far, complete lines become commands. Returns false once the client closed its side
+   static bool readCommands(int client,std::string& input,std::vector<std::string>& commands);
+   /// Accept a client and wait for its commands. Returns the client or -1
+   int receive(std::vector<std::string>& commands);
+   /// Send a reply to a client
+   static void reply(int client,const std::string& text);
+   /// Close a client connection
+   static void finish(int client);
+   /// Connect to a socket, send commands and collect the reply lines
+   static bool request(const std::string& path,const std::vector<std::string>& commands,std::vector<std::string>& replies);
+};
+//---------------------------------------------------------------------------
+#endif
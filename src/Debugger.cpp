@@ -18,22 +18,57 @@
 #include <iostream>
 #include <fstream>
 #include <cerrno>
+#include <cstdio>
 #include <string>
 #include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/user.h>
 #include <sys/wait.h>
 #include <unistd.h>
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
+/// The system call counters
+static Debugger::Counters counters;
+//---------------------------------------------------------------------------
+static void countPtrace(int request)
+   // Count a ptrace call
+{
+   switch (request) {
+      case PTRACE_PEEKTEXT: case PTRACE_PEEKDATA: counters.peeks++; break;
+      case PTRACE_POKETEXT: case PTRACE_POKEDATA: counters.pokes++; break;
+      case PTRACE_GETREGS: case PTRACE_SETREGS: counters.registers++; break;
+      case PTRACE_CONT: case PTRACE_SINGLESTEP: counters.resumes++; break;
+      default: counters.otherPtrace++; break;
+   }
+}
+//---------------------------------------------------------------------------
+template <class A,class D> static long tracePtrace(__ptrace_request request,pid_t pid,A addr,D data)
+   // A counted ptrace call
+{
+   countPtrace(request);
+   return ptrace(request,pid,addr,data);
+}
+//---------------------------------------------------------------------------
+static pid_t traceWait(pid_t pid,int* status,int options)
+   // A counted waitpid call
+{
+   counters.waits++;
+   return waitpid(pid,status,options);
+}
+//---------------------------------------------------------------------------
 static unsigned char peekbyte(pid_t child,const void* ptr)
    // Read client memory
 {
    unsigned long addr=reinterpret_cast<unsigned long>(ptr);
    unsigned long aligned=(addr/sizeof(long))*sizeof(long);
    union { long val; unsigned char data[sizeof(long)]; } data;
-   data.val=ptrace(PTRACE_PEEKTEXT,child,aligned,0);
+   data.val=tracePtrace(PTRACE_PEEKTEXT,child,aligned,0);
    //if (data.val==-1) {
    //  cerr << "ptrace(PTRACE_PEEKTEXT," << child << "," << aligned << ") failed: " << strerror(errno) << endl;
    //}
@@ -46,13 +81,80 @@ static void pokebyte(pid_t child,void* ptr,unsigned char c)
    unsigned long addr=reinterpret_cast<unsigned long>(ptr);
    unsigned long aligned=(addr/sizeof(long))*sizeof(long);
    union { long val; unsigned char data[sizeof(long)]; } data;
-   data.val=ptrace(PTRACE_PEEKTEXT,child,aligned,0);
+   data.val=tracePtrace(PTRACE_PEEKTEXT,child,aligned,0);
    data.data[addr-aligned]=c;
-   ptrace(PTRACE_POKETEXT,child,aligned,data.val);
+   tracePtrace(PTRACE_POKETEXT,child,aligned,data.val);
+}
+//---------------------------------------------------------------------------
+#if defined(__x86_64__)
+static const unsigned char syscallCode[]={0x0F,0x05,0xCC}; // syscall; int3
+#elif defined(__i386__)
+static const unsigned char syscallCode[]={0xCD,0x80,0xCC}; // int $0x80; int3
+#else
+   #error specify how to inject a system call
+#endif
+//---------------------------------------------------------------------------
+static long injectSyscall(pid_t child,long nr,long arg1,long arg2,long arg3,long arg4,long* forked=0)
+   // Make a stopped child execute a system call at its current IP
+{
+   counters.injected++;
+   user_regs_struct regs,callRegs;
+   memset(&regs,0,sizeof(regs));
+   tracePtrace(PTRACE_GETREGS,child,0,&regs);
+   callRegs=regs;
+#if defined(__x86_64__)
+   unsigned char* ip=reinterpret_cast<unsigned char*>(regs.rip);
+   callRegs.rax=nr; callRegs.rdi=arg1; callRegs.rsi=arg2; callRegs.rdx=arg3; callRegs.r10=arg4;
+#elif defined(__i386__)
+   unsigned char* ip=reinterpret_cast<unsigned char*>(regs.eip);
+   callRegs.eax=nr; callRegs.ebx=arg1; callRegs.ecx=arg2; callRegs.edx=arg3; callRegs.esi=arg4;
+#endif
+   unsigned char oldCode[sizeof(syscallCode)];
+   for (unsigned index=0;index<sizeof(syscallCode);index++) {
+      oldCode[index]=peekbyte(child,ip+index);
+      pokebyte(child,ip+index,syscallCode[index]);
+   }
+   tracePtrace(PTRACE_SETREGS,child,0,&callRegs);
+   if (forked)
+      tracePtrace(PTRACE_SETOPTIONS,child,0,PTRACE_O_TRACECLONE|PTRACE_O_TRACEFORK);
+
+   // Run until the trap behind the system call
+   long result=-ESRCH;
+   tracePtrace(PTRACE_CONT,child,0,0);
+   while (true) {
+      int status;
+      if ((traceWait(child,&status,__WALL)==-1)||(!WIFSTOPPED(status)))
+         return result;
+      if ((status>>8)==(SIGTRAP|(PTRACE_EVENT_FORK<<8))) {
+         unsigned long msg=0;
+         tracePtrace(PTRACE_GETEVENTMSG,child,0,&msg);
+         *forked=msg;
+         tracePtrace(PTRACE_CONT,child,0,0);
+         continue;
+      }
+      if (WSTOPSIG(status)==SIGTRAP)
+         break;
+      // Children of earlier runs are reaped explicitly, drop their SIGCHLD
+      tracePtrace(PTRACE_CONT,child,0,(WSTOPSIG(status)==SIGCHLD)?0:WSTOPSIG(status));
+   }
+   tracePtrace(PTRACE_GETREGS,child,0,&callRegs);
+#if defined(__x86_64__)
+   result=callRegs.rax;
+#elif defined(__i386__)
+   result=callRegs.eax;
+#endif
+
+   // Restore the original state
+   for (unsigned index=0;index<sizeof(syscallCode);index++)
+      pokebyte(child,ip+index,oldCode[index]);
+   tracePtrace(PTRACE_SETREGS,child,0,&regs);
+   if (forked)
+      tracePtrace(PTRACE_SETOPTIONS,child,0,PTRACE_O_TRACECLONE);
+   return result;
 }
 //---------------------------------------------------------------------------
 Debugger::Debugger()
-   : child(0), active(true), checkActive(false) 
+   : child(0), server(0), exitStatus(0), stopped(false), inputFd(-1), signalFd(-1), interruptPending(false), active(true), checkActive(false) 
    // Constructor
 {
 }
@@ -60,19 +162,19 @@ Debugger::Debugger()
 Debugger::~Debugger()
    // Destructor
 {
+   if (signalFd>=0)
+      ::close(signalFd);
 }
 //---------------------------------------------------------------------------
-bool Debugger::load(const string& executable,const vector<string>& arguments)
-   // Load a program
+static long startProcess(const string& executable,const vector<string>& arguments)
+   // Start a traced process, stopped at its first instruction
 {
-   // Close first if needed
-   close();
-
    // Basic check first
    if (access(executable.c_str(),X_OK)!=0)
-      return false;
+      return 0;
 
    // Executable exists, try to launch it
+   long child;
    if ((child=fork())==0) {
       // Construct the arguments array
       vector<const char*> args;
@@ -81,26 +183,36 @@ bool Debugger::load(const string& executable,const vector<string>& arguments)
          args.push_back((*iter).c_str());
       args.push_back(0);
       // And launch the process
-      ptrace(PTRACE_TRACEME,0,0,0);
+      tracePtrace(PTRACE_TRACEME,0,0,0);
       execv(executable.c_str(),const_cast<char**>(&args[0]));
       // Exec failed
       _exit(127);
    }
 
    // Fork error?
-   if (child==-1) {
-      child=0;
-      return false;
-   }
+   if (child==-1)
+      return 0;
 
    // Wait for the initial stop
    int status;
-   if ((waitpid(child,&status,0)==-1)||(!WIFSTOPPED(status))) {
-      close();
-      return false;
+   if ((traceWait(child,&status,0)==-1)||(!WIFSTOPPED(status))) {
+      tracePtrace(PTRACE_KILL,child,0,0);
+      return 0;
    }
-   ptrace(PTRACE_SETOPTIONS,child,0,PTRACE_O_TRACECLONE);
+   tracePtrace(PTRACE_SETOPTIONS,child,0,PTRACE_O_TRACECLONE);
+   return child;
+}
+//---------------------------------------------------------------------------
+bool Debugger::load(const string& executable,const vector<string>& arguments)
+   // Load a program
+{
+   // Close first if needed
+   close();
+
+   if ((child=startProcess(executable,arguments))==0)
+      return false;
    activeChild=child;
+   stopped=true;
 
    return true;
 }
@@ -109,12 +221,116 @@ bool Debugger::close()
    // Close the debugger
 {
    if (child) {
-      ptrace(PTRACE_KILL,child,0,0);
+      tracePtrace(PTRACE_KILL,child,0,0);
       child=0;
    }
+   if (server) {
+      tracePtrace(PTRACE_KILL,server,0,0);
+      server=0;
+   }
+   for (set<long>::const_iterator iter=launched.begin(),limit=launched.end();iter!=limit;++iter)
+      tracePtrace(PTRACE_KILL,*iter,0,0);
+   launched.clear();
+   return true;
+}
+//---------------------------------------------------------------------------
+bool Debugger::startForkServer()
+   // Turn the stopped program into a fork server
+{
+   if ((!child)||(activeChild!=child))
+      return false;
+   server=child;
+   child=0;
    return true;
 }
 //---------------------------------------------------------------------------
+bool Debugger::spawn()
+   // Fork a new child from the fork server
+{
+   if ((!server)||(child))
+      return false;
+
+   // Reap the children of previous runs, the server is stopped and cannot
+   while (injectSyscall(server,SYS_wait4,-1,0,WNOHANG,0)>0) ;
+
+   // Fork, the new child stops right away with a copy of the injected code
+   long newChild=0;
+   if (injectSyscall(server,SYS_fork,0,0,0,0,&newChild)<=0)
+      return false;
+   int status;
+   if ((!newChild)||(traceWait(newChild,&status,__WALL)==-1)||(!WIFSTOPPED(status)))
+      return false;
+   user_regs_struct regs;
+   memset(&regs,0,sizeof(regs));
+   tracePtrace(PTRACE_GETREGS,server,0,&regs);
+   tracePtrace(PTRACE_SETREGS,newChild,0,&regs);
+#if defined(__x86_64__)
+   unsigned char* ip=reinterpret_cast<unsigned char*>(regs.rip);
+#elif defined(__i386__)
+   unsigned char* ip=reinterpret_cast<unsigned char*>(regs.eip);
+#endif
+   for (unsigned index=0;index<sizeof(syscallCode);index++)
+      pokebyte(newChild,ip+index,peekbyte(server,ip+index));
+   tracePtrace(PTRACE_SETOPTIONS,newChild,0,PTRACE_O_TRACECLONE);
+   child=activeChild=newChild;
+   stopped=true;
+
+   return true;
+}
+//---------------------------------------------------------------------------
+bool Debugger::makeTemplate(const map<void*,BreakpointInfo>& addresses)
+   // Remember the patched code of the breakpoints set in the loaded program
+{
+   if ((!child)||(!stopped))
+      return false;
+
+   // Read every word containing a breakpoint once, adjacent words form a range
+   breakpointTemplate.clear();
+   unsigned long last=0;
+   for (map<void*,BreakpointInfo>::const_iterator iter=addresses.begin(),limit=addresses.end();iter!=limit;++iter) {
+      unsigned long aligned=(reinterpret_cast<unsigned long>((*iter).first)/sizeof(long))*sizeof(long);
+      if ((!breakpointTemplate.empty())&&(aligned==last))
+         continue;
+      union { long val; char data[sizeof(long)]; } data;
+      data.val=tracePtrace(PTRACE_PEEKTEXT,child,aligned,0);
+      if (breakpointTemplate.empty()||(aligned!=last+sizeof(long)))
+         breakpointTemplate.push_back(pair<unsigned long,string>(aligned,string()));
+      breakpointTemplate.back().second.append(data.data,sizeof(long));
+      last=aligned;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+long Debugger::launch(const string& executable,const vector<string>& arguments)
+   // Start another process of the same program with the template breakpoints
+{
+   long pid=startProcess(executable,arguments);
+   if (!pid)
+      return 0;
+
+   // Write the ranges through the memory file, which can patch the text directly.
+   // Fall back to one ptrace call per word
+   char memPath[40];
+   snprintf(memPath,sizeof(memPath),"/proc/%ld/mem",pid);
+   int mem=open(memPath,O_RDWR|O_CLOEXEC);
+   for (vector<pair<unsigned long,string> >::const_iterator iter=breakpointTemplate.begin(),limit=breakpointTemplate.end();iter!=limit;++iter) {
+      const string& code=(*iter).second;
+      if ((mem>=0)&&(pwrite(mem,code.data(),code.size(),(*iter).first)==static_cast<ssize_t>(code.size())))
+         continue;
+      for (unsigned index=0;index<code.size();index+=sizeof(long)) {
+         union { long val; char data[sizeof(long)]; } data;
+         memcpy(data.data,code.data()+index,sizeof(long));
+         tracePtrace(PTRACE_POKETEXT,pid,(*iter).first+index,data.val);
+      }
+   }
+   if (mem>=0)
+      ::close(mem);
+
+   tracePtrace(PTRACE_CONT,pid,0,0);
+   launched.insert(pid);
+   return pid;
+}
+//---------------------------------------------------------------------------
 bool Debugger::loadBaseAddresses()
 {
    // grep it from /proc/self/maps, first column is address
@@ -193,12 +409,46 @@ bool Debugger::removeBreakpoints(map<void*,BreakpointInfo>& addresses)
    return true;
 }
 //---------------------------------------------------------------------------
+bool Debugger::rearmBreakpoints(map<void*,BreakpointInfo>& addresses)
+   // Set the breakpoints that were hit again and reset their hit counts
+{
+   if ((!child)||(!stopped))
+      return false;
+
+   // Patch one word at a time, addresses are sorted
+   unsigned long current=0;
+   union { long val; unsigned char data[sizeof(long)]; } data;
+   bool dirty=false;
+   for (map<void*,BreakpointInfo>::iterator iter=addresses.begin(),limit=addresses.end();iter!=limit;++iter) {
+      if (!(*iter).second.hits)
+         continue;
+      (*iter).second.hits=0;
+      unsigned long addr=reinterpret_cast<unsigned long>((*iter).first);
+      unsigned long aligned=(addr/sizeof(long))*sizeof(long);
+      if ((!dirty)||(aligned!=current)) {
+         if (dirty)
+            tracePtrace(PTRACE_POKETEXT,activeChild,current,data.val);
+         current=aligned;
+         data.val=tracePtrace(PTRACE_PEEKTEXT,activeChild,current,0);
+         dirty=true;
+      }
+#if defined(__x86_64__)||defined(__i386__)
+      data.data[addr-aligned]=0xCC;
+#else
+   #error specify how to set a breakpoint
+#endif
+   }
+   if (dirty)
+      tracePtrace(PTRACE_POKETEXT,activeChild,current,data.val);
+   return true;
+}
+//---------------------------------------------------------------------------
 void Debugger::eliminateHitBreakpoint(BreakpointInfo& i)
    // Remove the breakpoint we just hit and adjust IP
 {
    user_regs_struct regs;
    memset(&regs,0,sizeof(regs));
-   ptrace(PTRACE_GETREGS,activeChild,0,&regs);
+   tracePtrace(PTRACE_GETREGS,activeChild,0,&regs);
 #if defined(__x86_64__)
    void* ptr=reinterpret_cast<void*>(--regs.rip);
 #elif defined(__i386__)
@@ -206,7 +456,7 @@ void Debugger::eliminateHitBreakpoint(BreakpointInfo& i)
 #else
    #error specify how to adjust the IP after a breakpoint
 #endif
-   ptrace(PTRACE_SETREGS,activeChild,0,&regs);
+   tracePtrace(PTRACE_SETREGS,activeChild,0,&regs);
    pokebyte(activeChild,ptr,i.oldCode);
 }
 //---------------------------------------------------------------------------
@@ -215,7 +465,7 @@ void Debugger::skipHitBreakPoint(BreakpointInfo& i)
 {
    user_regs_struct regs;
    memset(&regs,0,sizeof(regs));
-   ptrace(PTRACE_GETREGS,activeChild,0,&regs);
+   tracePtrace(PTRACE_GETREGS,activeChild,0,&regs);
 #if defined(__x86_64__)
    void* ptr=reinterpret_cast<void*>(--regs.rip);
 #elif defined(__i386__)
@@ -223,10 +473,10 @@ void Debugger::skipHitBreakPoint(BreakpointInfo& i)
 #else
    #error specify how to adjust the IP after a breakpoint
 #endif
-   ptrace(PTRACE_SETREGS,activeChild,0,&regs);
+   tracePtrace(PTRACE_SETREGS,activeChild,0,&regs);
    pokebyte(activeChild,ptr,i.oldCode);
    // step one instruction:
-   ptrace(PTRACE_SINGLESTEP,activeChild,0,0);
+   tracePtrace(PTRACE_SINGLESTEP,activeChild,0,0);
    // put breakpoint back
 #if defined(__x86_64__)||defined(__i386__)
    pokebyte(activeChild,ptr,0xCC);
@@ -234,20 +484,47 @@ void Debugger::skipHitBreakPoint(BreakpointInfo& i)
    #error specify how to set a breakpoint
 #endif
    // FIXME: should we check the status like in ::run()?
+   // Wait for the stepped thread only, other processes might be running
    int status;
-   waitpid(-1,&status,__WALL);
+   traceWait(activeChild,&status,__WALL);
 }
 //---------------------------------------------------------------------------
 Debugger::Event Debugger::run()
    // Run the program
 {
    // Continue the stopped child
-   ptrace(PTRACE_CONT,activeChild,0,0);
+   if (stopped)
+      tracePtrace(PTRACE_CONT,activeChild,0,0);
+   stopped=false;
 
    while (true) {
       // Wait for a child
       int status;
-      pid_t r=waitpid(-1,&status,__WALL);
+      pid_t r;
+      if (watched.empty()) {
+         r=traceWait(-1,&status,__WALL);
+      } else if ((r=traceWait(-1,&status,__WALL|WNOHANG))==0) {
+         // Nothing yet, sleep until a child changes state or input arrives
+         vector<pollfd> fds(watched.size()+1);
+         fds[0].fd=signalFd; fds[0].events=POLLIN;
+         for (unsigned index=0;index<watched.size();index++) {
+            fds[index+1].fd=watched[index];
+            fds[index+1].events=POLLIN;
+         }
+         counters.polls++;
+         if (poll(&fds[0],fds.size(),-1)<0)
+            continue;
+         if (fds[0].revents&POLLIN) {
+            signalfd_siginfo info;
+            while (read(signalFd,&info,sizeof(info))==sizeof(info)) ;
+         }
+         for (unsigned index=1;index<fds.size();index++)
+            if (fds[index].revents&(POLLIN|POLLHUP)) {
+               inputFd=fds[index].fd;
+               return Input;
+            }
+         continue;
+      }
 
       // Got no one?
       if (r==-1)
@@ -257,44 +534,55 @@ Debugger::Event Debugger::run()
       // A signal?
       if (WIFSTOPPED(status)) {
          // enable/disable logging
-         if (WSTOPSIG(status)==SIGUSR1) {
-           if (checkActive) {
-             cout << "** Bcov logging on" << endl;
-             active=true;
-           }
-           ptrace(PTRACE_CONT,activeChild,0,0);
+         if ((WSTOPSIG(status)==SIGUSR1)&&checkActive) {
+           cout << "** Bcov logging on" << endl;
+           active=true;
+           tracePtrace(PTRACE_CONT,activeChild,0,0);
            continue;
-         }          
-         if (WSTOPSIG(status)==SIGUSR2) {
-           if (checkActive) {
-             active=false;
-             cout << "** Bcov logging off" << endl;
-           }
-           ptrace(PTRACE_CONT,activeChild,0,0);
+         }
+         if ((WSTOPSIG(status)==SIGUSR2)&&checkActive) {
+           active=false;
+           cout << "** Bcov logging off" << endl;
+           tracePtrace(PTRACE_CONT,activeChild,0,0);
            continue;
-         }          
+         }
+         // Our own interrupt?
+         if ((WSTOPSIG(status)==SIGSTOP)&&interruptPending&&(activeChild==child)) {
+            interruptPending=false;
+            stopped=true;
+            return Interrupt;
+         }
          // A trap?
-         if (WSTOPSIG(status)==SIGTRAP)
+         if (WSTOPSIG(status)==SIGTRAP) {
+            stopped=true;
             return Trap;
+         }
          // No, deliber it directly
-         ptrace(PTRACE_CONT,activeChild,0,WSTOPSIG(status));
+         tracePtrace(PTRACE_CONT,activeChild,0,WSTOPSIG(status));
          continue;
       }
       // Thread died?
       if (WIFSIGNALED(status)||WIFEXITED(status)) {
-         if (activeChild==child)
+         if (activeChild==child) {
+            child=0;
+            exitStatus=status;
             return Exit;
+         }
+         if (launched.erase(activeChild)) {
+            exitStatus=status;
+            return Exit;
+         }
          continue;
       }
       // Stopped?
       if (WIFSTOPPED(status)) {
          // A new clone? Ignore the stop event
          if ((status>>8)==PTRACE_EVENT_CLONE) {
-            ptrace(PTRACE_CONT,activeChild,0,0);
+            tracePtrace(PTRACE_CONT,activeChild,0,0);
             continue;
          }
          // Hm, why did we stop? Ignore the event and continue
-         ptrace(PTRACE_CONT,activeChild,0,0);
+         tracePtrace(PTRACE_CONT,activeChild,0,0);
          continue;
       }
       // Unknown event
@@ -307,7 +595,7 @@ void* Debugger::getIP()
 {
    user_regs_struct regs;
    memset(&regs,0,sizeof(regs));
-   ptrace(PTRACE_GETREGS,activeChild,0,&regs);
+   tracePtrace(PTRACE_GETREGS,activeChild,0,&regs);
 #if defined(__x86_64__)
    return reinterpret_cast<void*>(regs.rip);
 #elif defined(__i386__)
@@ -327,16 +615,108 @@ void* Debugger::getIPBeforeTrap()
 #endif
 }
 //---------------------------------------------------------------------------
+unsigned long Debugger::getArgument(unsigned index)
+   // Get a function argument, only valid at the function entry
+{
+   user_regs_struct regs;
+   memset(&regs,0,sizeof(regs));
+   tracePtrace(PTRACE_GETREGS,activeChild,0,&regs);
+#if defined(__x86_64__)
+   switch (index) {
+      case 0: return regs.rdi;
+      case 1: return regs.rsi;
+      case 2: return regs.rdx;
+      case 3: return regs.rcx;
+      case 4: return regs.r8;
+      case 5: return regs.r9;
+      default: return 0;
+   }
+#elif defined(__i386__)
+   // Behind the return address on the stack
+   return tracePtrace(PTRACE_PEEKDATA,activeChild,regs.esp+4*(index+1),0);
+#else
+   #error specify how to read function arguments
+#endif
+}
+//---------------------------------------------------------------------------
+string Debugger::readString(unsigned long address,unsigned maxLength)
+   // Read a zero terminated string from the program
+{
+   string result;
+   if (!address)
+      return result;
+   while (result.length()<maxLength) {
+      unsigned long aligned=(address/sizeof(long))*sizeof(long);
+      errno=0;
+      union { long val; char data[sizeof(long)]; } data;
+      data.val=tracePtrace(PTRACE_PEEKDATA,activeChild,aligned,0);
+      if (errno)
+         break;
+      for (unsigned index=address-aligned;index<sizeof(long);index++) {
+         if ((!data.data[index])||(result.length()>=maxLength))
+            return result;
+         result+=data.data[index];
+      }
+      address=aligned+sizeof(long);
+   }
+   return result;
+}
+//---------------------------------------------------------------------------
 void Debugger::setActive(bool active)
 {
   this->active=active;
-  if (!active) {
-    // check for activation via SIGUSR1
-    checkActive=true;
-  }
 }
 
 bool Debugger::getActive()
 {
   return active;
 }
+//---------------------------------------------------------------------------
+void Debugger::setSignalControl(bool enabled)
+   // Toggle the active status with SIGUSR1 and SIGUSR2
+{
+  checkActive=enabled;
+}
+//---------------------------------------------------------------------------
+bool Debugger::watch(int fd)
+   // Let run() return when input is available on fd
+{
+   if (signalFd<0) {
+      // Child state changes are reported through a signalfd
+      sigset_t mask;
+      sigemptyset(&mask);
+      sigaddset(&mask,SIGCHLD);
+      if (sigprocmask(SIG_BLOCK,&mask,0)!=0)
+         return false;
+      if ((signalFd=signalfd(-1,&mask,SFD_NONBLOCK|SFD_CLOEXEC))<0)
+         return false;
+   }
+   watched.push_back(fd);
+   return true;
+}
+//---------------------------------------------------------------------------
+void Debugger::unwatch(int fd)
+   // Stop watching fd
+{
+   for (vector<int>::iterator iter=watched.begin();iter!=watched.end();)
+      if ((*iter)==fd)
+         iter=watched.erase(iter); else
+         ++iter;
+}
+//---------------------------------------------------------------------------
+bool Debugger::interrupt()
+   // Stop the running child, run() returns Interrupt once it has stopped
+{
+   if ((!child)||stopped)
+      return false;
+   if (syscall(SYS_tgkill,child,child,SIGSTOP)!=0)
+      return false;
+   interruptPending=true;
+   return true;
+}
+//---------------------------------------------------------------------------
+const Debugger::Counters& Debugger::getCounters()
+   // The system calls issued so far
+{
+   return counters;
+}
@@ -2,6 +2,7 @@
 #define H_Debugger
 //---------------------------------------------------------------------------
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 //---------------------------------------------------------------------------
@@ -22,13 +23,40 @@ class Debugger
       unsigned hits;
    };
    /// Possible events
-   enum Event { Error, Exit, Trap };
+   enum Event { Error, Exit, Trap, Input, Interrupt };
+   /// System call counters
+   struct Counters {
+      /// ptrace calls reading memory, writing memory, accessing registers, resuming and others
+      unsigned long peeks,pokes,registers,resumes,otherPtrace;
+      /// waitpid and poll calls
+      unsigned long waits,polls;
+      /// System calls injected into the fork server
+      unsigned long injected;
+   };
 
    private:
    /// The child
    long child;
    /// The currently active child (can be different when threaded)
    long activeChild;
+   /// The stopped fork server, if any
+   long server;
+   /// Further processes started with launch()
+   std::set<long> launched;
+   /// The text words containing breakpoints, as contiguous ranges
+   std::vector<std::pair<unsigned long,std::string> > breakpointTemplate;
+   /// The exit status of the last process that ended
+   int exitStatus;
+   /// Is the active child stopped?
+   bool stopped;
+   /// The watched inputs
+   std::vector<int> watched;
+   /// The input that became readable
+   int inputFd;
+   /// The signalfd reporting child state changes
+   int signalFd;
+   /// Did we request an interrupt?
+   bool interruptPending;
    /// A map of base adresses for loaded modules
    std::map<std::string,unsigned long> baseAddress;
    /// active status
@@ -46,6 +74,18 @@ class Debugger
    /// Close the debugger
    bool close();
 
+   /// Turn the stopped program into a fork server
+   bool startForkServer();
+   /// Fork a new child from the fork server
+   bool spawn();
+
+   /// Remember the patched code of the breakpoints set in the loaded program
+   bool makeTemplate(const std::map<void*,BreakpointInfo>& addresses);
+   /// Start another process of the same program with the template breakpoints, it runs concurrently
+   long launch(const std::string& executable,const std::vector<std::string>& arguments);
+   /// The exit status of the process that ended last
+   int getExitStatus() const { return exitStatus; }
+
    bool loadBaseAddresses();
    unsigned long getBaseAddress(std::string library);
 
@@ -53,20 +93,43 @@ class Debugger
    bool setBreakpoints(std::map<void*,BreakpointInfo>& addresses);
    /// Remove breakpoints
    bool removeBreakpoints(std::map<void*,BreakpointInfo>& addresses);
+   /// Set the breakpoints that were hit again and reset their hit counts
+   bool rearmBreakpoints(std::map<void*,BreakpointInfo>& addresses);
    /// Remove the breakpoint we just hit and adjust IP
    void eliminateHitBreakpoint(BreakpointInfo& i);
    /// Skip the breakpoint we just hit and adjust IP
    void skipHitBreakPoint(BreakpointInfo& i);
    /// Run the program
    Event run();
+   /// Let run() return Input when fd becomes readable
+   bool watch(int fd);
+   /// Stop watching fd
+   void unwatch(int fd);
+   /// The input that became readable
+   int getInput() const { return inputFd; }
+   /// Stop the running program, run() returns Interrupt once it stopped
+   bool interrupt();
    /// Get the current IP
    void* getIP();
    /// Get the current IP if we executed a trap instruction
    void* getIPBeforeTrap();
+   /// Get a function argument, only valid at the function entry
+   unsigned long getArgument(unsigned index);
+   /// Read a zero terminated string from the program
+   std::string readString(unsigned long address,unsigned maxLength);
+   /// Is the program stopped?
+   bool isStopped() const { return stopped; }
+   /// The thread that caused the last event
+   long getThread() const { return activeChild; }
    
    /// active status
    void setActive(bool active);
    bool getActive();
+   /// Toggle the active status with SIGUSR1 and SIGUSR2
+   void setSignalControl(bool enabled);
+
+   /// The system calls issued so far
+   static const Counters& getCounters();
 };
 //---------------------------------------------------------------------------
 #endif
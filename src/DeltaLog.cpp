@@ -0,0 +1,121 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "DeltaLog.hpp"
+#include <iostream>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+static unsigned long long now()
+   // The monotonic time in milliseconds
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return static_cast<unsigned long long>(ts.tv_sec)*1000+ts.tv_nsec/1000000;
+}
+//---------------------------------------------------------------------------
+DeltaLog::DeltaLog()
+   : fd(-1), timer(-1), batchSize(1), start(0)
+   // Constructor
+{
+}
+//---------------------------------------------------------------------------
+DeltaLog::~DeltaLog()
+   // Destructor
+{
+   close();
+}
+//---------------------------------------------------------------------------
+bool DeltaLog::open(const string& fileName,unsigned batchSize,unsigned intervalMs)
+   // Create the log
+{
+   close();
+   if ((fd=::open(fileName.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC,0666))<0) {
+      cerr << "unable to write " << fileName << endl;
+      return false;
+   }
+   this->batchSize=batchSize?batchSize:1;
+   start=now();
+   if (intervalMs) {
+      if ((timer=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC))<0)
+         return false;
+      itimerspec spec;
+      spec.it_interval.tv_sec=intervalMs/1000;
+      spec.it_interval.tv_nsec=(intervalMs%1000)*1000000;
+      spec.it_value=spec.it_interval;
+      timerfd_settime(timer,0,&spec,0);
+   }
+   return append("bcovlog 1\n");
+}
+//---------------------------------------------------------------------------
+void DeltaLog::close()
+   // Flush and close the log
+{
+   if (fd>=0) {
+      flush();
+      ::close(fd);
+      fd=-1;
+   }
+   if (timer>=0) {
+      ::close(timer);
+      timer=-1;
+   }
+}
+//---------------------------------------------------------------------------
+bool DeltaLog::append(const string& text)
+   // Append records directly
+{
+   const char* pos=text.c_str();
+   for (size_t left=text.length();left;) {
+      ssize_t len=write(fd,pos,left);
+      if (len<=0) return false;
+      pos+=len; left-=len;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool DeltaLog::flush()
+   // Write the pending hits as a single record
+{
+   if (pending.empty())
+      return true;
+   string record;
+   record.reserve(32+19*pending.size());
+   char buffer[32];
+   snprintf(buffer,sizeof(buffer),"hits %llu",now()-start);
+   record+=buffer;
+   for (vector<void*>::const_iterator iter=pending.begin(),limit=pending.end();iter!=limit;++iter) {
+      snprintf(buffer,sizeof(buffer)," %lx",reinterpret_cast<unsigned long>(*iter));
+      record+=buffer;
+   }
+   record+='\n';
+   pending.clear();
+   return append(record);
+}
+//---------------------------------------------------------------------------
+void DeltaLog::tick()
+   // Handle an expired timer
+{
+   unsigned long long expirations;
+   if (read(timer,&expirations,sizeof(expirations))>0)
+      flush();
+}
+//---------------------------------------------------------------------------
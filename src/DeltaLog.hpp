@@ -0,0 +1,44 @@
+#ifndef H_DeltaLog
+#define H_DeltaLog
+//---------------------------------------------------------------------------
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+/// An append-only log of newly hit addresses, written in batches
+class DeltaLog
+{
+   private:
+   /// The log file
+   int fd;
+   /// The timer triggering periodic flushes, if any
+   int timer;
+   /// Hits not written yet
+   std::vector<void*> pending;
+   /// Flush after that many hits
+   unsigned batchSize;
+   /// The start time in milliseconds
+   unsigned long long start;
+
+   public:
+   /// Constructor
+   DeltaLog();
+   /// Destructor
+   ~DeltaLog();
+
+   /// Create the log. A zero interval disables periodic flushes
+   bool open(const std::string& fileName,unsigned batchSize,unsigned intervalMs);
+   /// Flush and close the log
+   void close();
+   /// Append records directly
+   bool append(const std::string& text);
+   /// Record a newly hit address
+   void hit(void* address) { pending.push_back(address); if (pending.size()>=batchSize) flush(); }
+   /// Write the pending hits
+   bool flush();
+   /// The timer, readable whenever the flush interval elapsed. -1 if none
+   int getTimer() const { return timer; }
+   /// Handle an expired timer
+   void tick();
+};
+//---------------------------------------------------------------------------
+#endif
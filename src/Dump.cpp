@@ -0,0 +1,887 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "Dump.hpp"
+#include <iostream>
+#include <fstream>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// The magic bytes of a binary dump
+static const char binaryMagic[8]={'B','C','O','V','D','U','M','P'};
+/// The binary format version
+static const unsigned binaryVersion=2;
+/// The section kinds
+enum SectionKind { StringSection=1, HeaderSection=2, CoverageSection=3, TimelineSection=4 };
+/// A missing string
+static const unsigned noString=~0u;
+/// The file encodings
+enum FileEncoding { BitmapEncoding=0, SlotEncoding=2 };
+/// The size of a timeline record
+static const unsigned timelineRecordSize=20;
+//---------------------------------------------------------------------------
+unsigned long long readLittleEndian(const unsigned char* data,unsigned bytes)
+   // Read an integer in little endian byte order
+{
+   unsigned long long result=0;
+   for (unsigned index=bytes;index>0;index--)
+      result=(result<<8)|data[index-1];
+   return result;
+}
+//---------------------------------------------------------------------------
+void appendLittleEndian(string& out,unsigned long long value,unsigned bytes)
+   // Append an integer in little endian byte order
+{
+   for (unsigned index=0;index<bytes;index++,value>>=8)
+      out+=static_cast<char>(value&0xFF);
+}
+//---------------------------------------------------------------------------
+void hashBytes(unsigned long long& hash,const void* data,unsigned long len)
+   // Add bytes to a FNV-1a hash
+{
+   const unsigned char* bytes=static_cast<const unsigned char*>(data);
+   for (unsigned long index=0;index<len;index++)
+      hash=(hash^bytes[index])*1099511628211ull;
+}
+//---------------------------------------------------------------------------
+bool readList(const string& fileName,vector<string>& files)
+   // Read a list of file names, one per line
+{
+   ifstream in(fileName.c_str());
+   if (!in.is_open()) {
+      cerr << "unable to read " << fileName << endl;
+      return false;
+   }
+   string line;
+   while (getline(in,line))
+      if (line!="")
+         files.push_back(line);
+   return true;
+}
+//---------------------------------------------------------------------------
+static void appendVarint(string& out,unsigned value)
+   // Append a LEB128 encoded integer
+{
+   while (value>=0x80) {
+      out+=static_cast<char>((value&0x7F)|0x80);
+      value>>=7;
+   }
+   out+=static_cast<char>(value);
+}
+//---------------------------------------------------------------------------
+static bool readVarint(const unsigned char*& pos,const unsigned char* limit,unsigned& value)
+   // Read a LEB128 encoded integer
+{
+   value=0;
+   for (unsigned shift=0;(pos<limit)&&(shift<35);shift+=7) {
+      unsigned char c=*(pos++);
+      value|=static_cast<unsigned>(c&0x7F)<<shift;
+      if (!(c&0x80))
+         return true;
+   }
+   return false;
+}
+//---------------------------------------------------------------------------
+unsigned onlineCpus()
+   // The number of online cpus. sysconf fails with -1, which must not become a huge thread count
+{
+   static const long maxCpus=1024;
+   long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+   if (cpus<1) return 1;
+   if (cpus>maxCpus) return maxCpus;
+   return cpus;
+}
+//---------------------------------------------------------------------------
+static inline LineSlots::Word firstBits(unsigned count,unsigned word)
+   // The word of a bitmap with the first count bits set
+{
+   if (count>=64*(word+1)) return ~0ull;
+   if (count<=64*word) return 0;
+   return (1ull<<(count-64*word))-1;
+}
+//---------------------------------------------------------------------------
+unsigned LineSlots::count(const vector<Word>& bits)
+   // Number of bits set
+{
+   unsigned result=0;
+   for (vector<Word>::const_iterator iter=bits.begin(),limit=bits.end();iter!=limit;++iter)
+      result+=__builtin_popcountll(*iter);
+   return result;
+}
+//---------------------------------------------------------------------------
+void LineSlots::assign(unsigned hitsPossible,unsigned armedCount,unsigned hitCount)
+   // Arm resp. hit the first addresses
+{
+   unsigned words=LineSlots::words(hitsPossible);
+   armed.resize(words);
+   hits.resize(words);
+   for (unsigned index=0;index<words;index++) {
+      armed[index]=firstBits(armedCount,index);
+      hits[index]=firstBits(hitCount,index);
+   }
+}
+//---------------------------------------------------------------------------
+void LineSlots::merge(const LineSlots& other)
+   // Add the addresses of another line. Lines of different builds can differ in size, the larger one wins
+{
+   if (armed.size()<other.armed.size()) armed.resize(other.armed.size(),0);
+   if (hits.size()<other.hits.size()) hits.resize(other.hits.size(),0);
+   for (unsigned index=0;index<other.armed.size();index++)
+      armed[index]|=other.armed[index];
+   for (unsigned index=0;index<other.hits.size();index++)
+      hits[index]|=other.hits[index];
+}
+//---------------------------------------------------------------------------
+static void appendSlotText(string& out,const vector<LineSlots::Word>& bits)
+   // Append a bitmap as hex number
+{
+   unsigned index=bits.size();
+   while ((index>1)&&(!bits[index-1]))
+      index--;
+   char buffer[20];
+   snprintf(buffer,sizeof(buffer),"%llx",index?bits[index-1]:0ull);
+   out+=buffer;
+   for (;index>1;index--) {
+      snprintf(buffer,sizeof(buffer),"%016llx",bits[index-2]);
+      out+=buffer;
+   }
+}
+//---------------------------------------------------------------------------
+static bool readSlotText(const char*& pos,const char* limit,unsigned hitsPossible,vector<LineSlots::Word>& bits)
+   // Read a hex bitmap, skipping the blanks before it. Bits beyond the addresses are dropped
+{
+   while ((pos<limit)&&(((*pos)==' ')||((*pos)=='\t')))
+      ++pos;
+   const char* start=pos;
+   while ((pos<limit)&&isxdigit(static_cast<unsigned char>(*pos)))
+      ++pos;
+   if (pos==start)
+      return false;
+   unsigned words=LineSlots::words(hitsPossible);
+   bits.assign(words,0);
+   unsigned bit=0;
+   for (const char* digit=pos;(digit>start)&&(bit<64*words);bit+=4) {
+      char c=*(--digit);
+      LineSlots::Word value=(c<='9')?(c-'0'):((c|0x20)-'a'+10);
+      bits[bit/64]|=value<<(bit%64);
+   }
+   if (words)
+      bits[words-1]&=firstBits(hitsPossible,words-1);
+   return true;
+}
+//---------------------------------------------------------------------------
+static void appendSlotBytes(string& out,const vector<LineSlots::Word>& bits,unsigned hitsPossible)
+   // Append a bitmap as (hitsPossible+7)/8 bytes
+{
+   for (unsigned index=0;index<(hitsPossible+7)/8;index++)
+      out+=static_cast<char>((index/8<bits.size())?((bits[index/8]>>(8*(index%8)))&0xFF):0);
+}
+//---------------------------------------------------------------------------
+static void readSlotBytes(const unsigned char* data,unsigned hitsPossible,vector<LineSlots::Word>& bits)
+   // Read a bitmap of (hitsPossible+7)/8 bytes
+{
+   unsigned words=LineSlots::words(hitsPossible);
+   bits.assign(words,0);
+   for (unsigned index=0;index<(hitsPossible+7)/8;index++)
+      bits[index/8]|=static_cast<LineSlots::Word>(data[index])<<(8*(index%8));
+   if (words)
+      bits[words-1]&=firstBits(hitsPossible,words-1);
+}
+//---------------------------------------------------------------------------
+DumpReader::~DumpReader()
+   // Destructor
+{
+}
+//---------------------------------------------------------------------------
+void DumpReader::header(const string& /*name*/,const string& /*value*/)
+   // A header entry
+{
+}
+//---------------------------------------------------------------------------
+bool DumpReader::epoch(const string& /*name*/)
+   // The start of an epoch section
+{
+   return false;
+}
+//---------------------------------------------------------------------------
+void DumpReader::segment()
+   // The start of a segment
+{
+}
+//---------------------------------------------------------------------------
+void DumpReader::timeline(unsigned /*fileNo*/,unsigned /*lineNo*/,unsigned long long /*time*/,unsigned /*thread*/)
+   // A first hit
+{
+}
+//---------------------------------------------------------------------------
+bool DumpReader::read(const string& fileName,bool lock)
+   // Read a dump file
+{
+   int fd=open(fileName.c_str(),O_RDONLY);
+   if (fd<0) {
+      cerr << "unable to open " << fileName << endl;
+      return false;
+   }
+   // Wait for runs appending or compacting, a file truncated under the mapping would fault
+   if (lock&&(flock(fd,LOCK_SH)!=0)&&(errno!=ENOLCK)) {
+      cerr << "unable to lock " << fileName << endl;
+      ::close(fd);
+      return false;
+   }
+   struct stat info;
+   if (fstat(fd,&info)!=0) {
+      cerr << "unable to open " << fileName << endl;
+      ::close(fd);
+      return false;
+   }
+   if (!info.st_size) {
+      ::close(fd);
+      return true;
+   }
+   void* data=mmap(0,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+   if (data==MAP_FAILED) {
+      cerr << "unable to map " << fileName << endl;
+      ::close(fd);
+      return false;
+   }
+   bool result;
+   if ((static_cast<unsigned long>(info.st_size)>=sizeof(binaryMagic))&&(memcmp(data,binaryMagic,sizeof(binaryMagic))==0)) {
+      // Appended runs form further segments
+      result=true;
+      const unsigned char* pos=static_cast<const unsigned char*>(data);
+      for (unsigned long remaining=info.st_size,used;remaining&&result;pos+=used,remaining-=used) {
+         if ((remaining<sizeof(binaryMagic))||(memcmp(pos,binaryMagic,sizeof(binaryMagic))!=0)) {
+            result=false;
+            break;
+         }
+         segment();
+         result=readBinary(pos,remaining,used);
+      }
+   } else {
+      result=readText(static_cast<const char*>(data),info.st_size);
+   }
+   munmap(data,info.st_size);
+   ::close(fd);
+   if (!result)
+      cerr << "corrupt dump " << fileName << endl;
+   return result;
+}
+//---------------------------------------------------------------------------
+/// A line of a text dump, scanned but not interpreted yet
+struct DumpReader::TextRecord
+{
+   /// The kinds
+   enum Kind { Line, Command, Args, Date, Sample, Epoch, File, Timeline };
+   /// The kind
+   unsigned kind;
+   /// The numbers of a line, the entry count of a timeline
+   unsigned values[4];
+   /// The text of the line, the slot bitmaps of a line, the records of a timeline
+   const char* text;
+   /// The text length
+   unsigned len;
+};
+//---------------------------------------------------------------------------
+/// A part of a text dump, scanned by its own thread
+struct DumpReader::TextChunk
+{
+   /// The range to scan, starting at a line
+   const char* begin,*limit;
+   /// Where scanning actually stopped. A timeline can extend beyond the limit
+   const char* end;
+   /// Was the content valid?
+   bool ok;
+   /// The lines
+   vector<TextRecord> records;
+};
+//---------------------------------------------------------------------------
+static inline bool scanNumber(const char*& pos,const char* limit,unsigned& value)
+   // Read a decimal number, skipping the blanks before it
+{
+   while ((pos<limit)&&(((*pos)==' ')||((*pos)=='\t')))
+      ++pos;
+   if ((pos>=limit)||(static_cast<unsigned>((*pos)-'0')>9))
+      return false;
+   value=0;
+   for (;(pos<limit)&&(static_cast<unsigned>((*pos)-'0')<=9);++pos)
+      value=value*10+((*pos)-'0');
+   return true;
+}
+//---------------------------------------------------------------------------
+void* DumpReader::scanText(void* data)
+   // Scan a part of a text dump. Only splits the lines, the callbacks are invoked by replayText
+{
+   TextChunk& chunk=*static_cast<TextChunk*>(data);
+   chunk.ok=true;
+   const char* pos=chunk.begin,*limit=chunk.limit;
+   while (pos<limit) {
+      const char* end=static_cast<const char*>(memchr(pos,'\n',limit-pos));
+      if (!end) end=limit;
+      const char* next=end+1;
+      // Strip the current line
+      while ((end>pos)&&((end[-1]=='\r')||(end[-1]==' ')||(end[-1]=='\t')))
+         --end;
+      unsigned len=end-pos;
+      const char* currentLine=pos;
+      pos=next;
+      if (!len) continue;
+
+      TextRecord record;
+      record.text=currentLine;
+      record.len=len;
+      if (static_cast<unsigned>(currentLine[0]-'0')<=9) {
+         // A regular line
+         const char* p=currentLine;
+         record.kind=TextRecord::Line;
+         if ((!scanNumber(p,end,record.values[0]))||(!scanNumber(p,end,record.values[1]))||(!scanNumber(p,end,record.values[2])))
+            continue;
+         // Without sampling every address is instrumented. Lines armed or hit partially give the bitmaps
+         if (!scanNumber(p,end,record.values[3]))
+            record.values[3]=record.values[1];
+         record.text=p;
+         record.len=end-p;
+      } else if ((len>9)&&(memcmp(currentLine,"timeline ",9)==0)) {
+         // The binary records follow, another segment might come after them
+         const char* p=currentLine+9;
+         if (!scanNumber(p,end,record.values[0]))
+            record.values[0]=0;
+         if ((pos>chunk.limit)||(static_cast<unsigned long>(chunk.limit-pos)<static_cast<unsigned long>(record.values[0])*timelineRecordSize)) {
+            // The chunk might just end too early, the caller checks
+            chunk.ok=false;
+            break;
+         }
+         record.kind=TextRecord::Timeline;
+         record.text=pos;
+         pos+=static_cast<unsigned long>(record.values[0])*timelineRecordSize;
+      } else if ((len>8)&&(memcmp(currentLine,"command ",8)==0)) {
+         record.kind=TextRecord::Command; record.text+=8; record.len-=8;
+      } else if ((len>=4)&&(memcmp(currentLine,"args",4)==0)&&((len==4)||(currentLine[4]==' '))) {
+         record.kind=TextRecord::Args; record.text+=(len>4)?5:4; record.len-=(len>4)?5:4;
+      } else if ((len>5)&&(memcmp(currentLine,"date ",5)==0)) {
+         record.kind=TextRecord::Date; record.text+=5; record.len-=5;
+      } else if ((len>7)&&(memcmp(currentLine,"sample ",7)==0)) {
+         record.kind=TextRecord::Sample; record.text+=7; record.len-=7;
+      } else if ((len>6)&&(memcmp(currentLine,"epoch ",6)==0)) {
+         record.kind=TextRecord::Epoch; record.text+=6; record.len-=6;
+      } else if ((len>5)&&(memcmp(currentLine,"file ",5)==0)) {
+         record.kind=TextRecord::File; record.text+=5; record.len-=5;
+      } else continue;
+      chunk.records.push_back(record);
+   }
+   chunk.end=(pos<limit)?pos:limit;
+   return 0;
+}
+//---------------------------------------------------------------------------
+void DumpReader::replayText(const TextChunk& chunk,bool& skip,bool& skipEpoch)
+   // Pass the scanned lines on
+{
+   for (vector<TextRecord>::const_iterator iter=chunk.records.begin(),limit=chunk.records.end();iter!=limit;++iter) {
+      const TextRecord& record=*iter;
+      switch (record.kind) {
+         case TextRecord::Line:
+            if (!skip) {
+               unsigned hitsPossible=record.values[1],hits=record.values[2],armed=record.values[3];
+               const char* pos=record.text,*limit=pos+record.len;
+               if (readSlotText(pos,limit,hitsPossible,slots.armed)&&readSlotText(pos,limit,hitsPossible,slots.hits)) {
+                  hits=LineSlots::count(slots.hits);
+                  armed=LineSlots::count(slots.armed);
+               } else {
+                  slots.assign(hitsPossible,armed,hits);
+               }
+               line(record.values[0],hitsPossible,hits,armed,slots);
+            }
+            break;
+         case TextRecord::Timeline: {
+            const unsigned char* pos=reinterpret_cast<const unsigned char*>(record.text);
+            for (unsigned index=0;index<record.values[0];index++,pos+=timelineRecordSize)
+               timeline(readLittleEndian(pos,4),readLittleEndian(pos+4,4),readLittleEndian(pos+8,8),readLittleEndian(pos+16,4));
+            break;
+         }
+         case TextRecord::Command:
+            // The command starts a new segment
+            skip=true; skipEpoch=false;
+            segment();
+            header("command",string(record.text,record.len));
+            break;
+         case TextRecord::Args: header("args",string(record.text,record.len)); break;
+         case TextRecord::Date: header("date",string(record.text,record.len)); break;
+         case TextRecord::Sample: header("sample",string(record.text,record.len)); break;
+         case TextRecord::Epoch: skip=skipEpoch=!epoch(string(record.text,record.len)); break;
+         case TextRecord::File: if (!skipEpoch) skip=!file(string(record.text,record.len)); break;
+      }
+   }
+}
+//---------------------------------------------------------------------------
+bool DumpReader::readText(const char* data,unsigned long size)
+   // Read a text dump. Big dumps are scanned in parallel, cut into chunks at file lines
+{
+   static const unsigned long chunkSize=1<<20,parallelSize=8<<20;
+   unsigned threads=(size>=parallelSize)?onlineCpus():1;
+   vector<TextChunk> chunks(threads);
+   vector<pthread_t> ids(threads);
+   bool skip=true,skipEpoch=false;
+   const char* limit=data+size;
+   for (const char* pos=data;pos<limit;) {
+      // Cut the next chunks, each but the last ends in front of a file line
+      unsigned count=0;
+      for (const char* from=pos;(from<limit)&&(count<threads);count++) {
+         const char* to=limit;
+         if (static_cast<unsigned long>(limit-from)>chunkSize) {
+            const char* cut=static_cast<const char*>(memmem(from+chunkSize-1,limit-from-chunkSize+1,"\nfile ",6));
+            if (cut) to=cut+1;
+         }
+         TextChunk& chunk=chunks[count];
+         chunk.begin=from; chunk.limit=to;
+         chunk.records.clear();
+         from=to;
+      }
+
+      // Scan them
+      unsigned started=1;
+      for (;started<count;started++)
+         if (pthread_create(&ids[started],0,scanText,&chunks[started])!=0)
+            break;
+      for (unsigned index=started;index<count;index++)
+         scanText(&chunks[index]);
+      scanText(&chunks[0]);
+      for (unsigned index=1;index<started;index++)
+         pthread_join(ids[index],0);
+
+      // And interpret them in order. A timeline can swallow the start of the next
+      // chunk, the next round starts behind it then
+      for (unsigned index=0;index<count;index++) {
+         TextChunk& chunk=chunks[index];
+         if (chunk.begin!=pos)
+            break;
+         if ((!chunk.ok)&&(chunk.limit!=limit)) {
+            // A timeline crossing the chunk end, rescan from there up to the end
+            chunk.records.clear();
+            chunk.limit=limit;
+            scanText(&chunk);
+         }
+         replayText(chunk,skip,skipEpoch);
+         if (!chunk.ok)
+            return false;
+         pos=chunk.end;
+      }
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool DumpReader::readBinary(const unsigned char* data,unsigned long size,unsigned long& used)
+   // Read one segment of a binary dump
+{
+   if ((size<16)||(readLittleEndian(data+8,4)!=binaryVersion)) {
+      cerr << "unsupported dump version" << endl;
+      return false;
+   }
+   unsigned sectionCount=readLittleEndian(data+12,4);
+   if ((size-16)/24<sectionCount)
+      return false;
+   // The segment ends behind its last section
+   used=16+24*sectionCount;
+
+   // Find the string table first
+   const unsigned char* stringOffsets=0,*stringData=0;
+   unsigned stringCount=0;
+   unsigned long stringDataSize=0;
+   for (unsigned index=0;index<sectionCount;index++) {
+      const unsigned char* entry=data+16+24*index;
+      unsigned long long offset=readLittleEndian(entry+8,8),len=readLittleEndian(entry+16,8);
+      if ((offset>size)||(len>size-offset))
+         return false;
+      used=max<unsigned long>(used,offset+len);
+      if (readLittleEndian(entry,4)!=StringSection)
+         continue;
+      if (len<4) return false;
+      stringCount=readLittleEndian(data+offset,4);
+      if ((len-4)/4<static_cast<unsigned long long>(stringCount)+1) return false;
+      stringOffsets=data+offset+4;
+      stringData=stringOffsets+4*(stringCount+1);
+      stringDataSize=len-4-4*(stringCount+1);
+   }
+   vector<string> strings(stringCount);
+   for (unsigned index=0;index<stringCount;index++) {
+      unsigned long from=readLittleEndian(stringOffsets+4*index,4),to=readLittleEndian(stringOffsets+4*index+4,4);
+      if ((from>to)||(to>stringDataSize))
+         return false;
+      strings[index].assign(reinterpret_cast<const char*>(stringData+from),to-from);
+   }
+
+   // Interpret the sections in order
+   for (unsigned index=0;index<sectionCount;index++) {
+      const unsigned char* entry=data+16+24*index;
+      unsigned kind=readLittleEndian(entry,4),name=readLittleEndian(entry+4,4);
+      const unsigned char* pos=data+readLittleEndian(entry+8,8),*limit=pos+readLittleEndian(entry+16,8);
+      if ((name!=noString)&&(name>=stringCount))
+         return false;
+      switch (kind) {
+         case HeaderSection: {
+            if (limit-pos<4) return false;
+            unsigned count=readLittleEndian(pos,4);
+            if (static_cast<unsigned long>(limit-pos-4)/8<count) return false;
+            for (pos+=4;count;--count,pos+=8) {
+               unsigned key=readLittleEndian(pos,4),value=readLittleEndian(pos+4,4);
+               if ((key>=stringCount)||(value>=stringCount)) return false;
+               header(strings[key],strings[value]);
+            }
+            break;
+         }
+         case CoverageSection: {
+            // The totals have no name
+            if ((name!=noString)&&(!epoch(strings[name])))
+               break;
+            if (limit-pos<4) return false;
+            unsigned fileCount=readLittleEndian(pos,4);
+            for (pos+=4;fileCount;--fileCount) {
+               if (limit-pos<16) return false;
+               unsigned path=readLittleEndian(pos,4),lineCount=readLittleEndian(pos+4,4),encoding=readLittleEndian(pos+8,4),dataSize=readLittleEndian(pos+12,4);
+               pos+=16;
+               if ((path>=stringCount)||(static_cast<unsigned long>(limit-pos)/4<lineCount)) return false;
+               const unsigned char* lineNumbers=pos;
+               pos+=4*lineCount;
+               if (static_cast<unsigned long>(limit-pos)<dataSize) return false;
+               const unsigned char* values=pos,*valuesLimit=pos+dataSize;
+               pos+=(dataSize+3)&~3u;
+               if (pos>limit) pos=limit;
+               if (!file(strings[path]))
+                  continue;
+               if (encoding==BitmapEncoding) {
+                  // The possible hits, followed by the hit bitmap
+                  const unsigned char* bitmap=values;
+                  for (unsigned index2=0;index2<lineCount;index2++) {
+                     unsigned hitsPossible;
+                     if (!readVarint(bitmap,valuesLimit,hitsPossible)) return false;
+                  }
+                  if (static_cast<unsigned long>(valuesLimit-bitmap)<(lineCount+7)/8) return false;
+                  for (unsigned index2=0;index2<lineCount;index2++) {
+                     unsigned hitsPossible;
+                     readVarint(values,valuesLimit,hitsPossible);
+                     bool hit=(bitmap[index2/8]>>(index2%8))&1;
+                     slots.assign(hitsPossible,hitsPossible,hit?hitsPossible:0);
+                     line(readLittleEndian(lineNumbers+4*index2,4),hitsPossible,hit?hitsPossible:0,hitsPossible,slots);
+                  }
+               } else if (encoding==SlotEncoding) {
+                  // The counts, followed by the bitmaps of lines needing them
+                  for (unsigned index2=0;index2<lineCount;index2++) {
+                     unsigned hitsPossible,hits,armed;
+                     if ((!readVarint(values,valuesLimit,hitsPossible))||(!readVarint(values,valuesLimit,hits))||(!readVarint(values,valuesLimit,armed)))
+                        return false;
+                     if (LineSlots::needed(hitsPossible,hits,armed)) {
+                        unsigned long bytes=(static_cast<unsigned long>(hitsPossible)+7)/8;
+                        if (static_cast<unsigned long>(valuesLimit-values)/2<bytes) return false;
+                        readSlotBytes(values,hitsPossible,slots.armed);
+                        readSlotBytes(values+bytes,hitsPossible,slots.hits);
+                        values+=2*bytes;
+                        hits=LineSlots::count(slots.hits);
+                        armed=LineSlots::count(slots.armed);
+                     } else {
+                        slots.assign(hitsPossible,armed,hits);
+                     }
+                     line(readLittleEndian(lineNumbers+4*index2,4),hitsPossible,hits,armed,slots);
+                  }
+               } else return false;
+            }
+            break;
+         }
+         case TimelineSection: {
+            if (limit-pos<8) return false;
+            unsigned count=readLittleEndian(pos,4);
+            if (static_cast<unsigned long>(limit-pos-8)/timelineRecordSize<count) return false;
+            for (pos+=8;count;--count,pos+=timelineRecordSize)
+               timeline(readLittleEndian(pos,4),readLittleEndian(pos+4,4),readLittleEndian(pos+8,8),readLittleEndian(pos+16,4));
+            break;
+         }
+         default: break; // Unknown sections are skipped
+      }
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+DumpWriter::DumpWriter(Format format)
+   : format(format),out(0),coverageName(noString),coverageFiles(0),currentFile(noString),timelineCount(0)
+   // Constructor
+{
+}
+//---------------------------------------------------------------------------
+DumpWriter::~DumpWriter()
+   // Destructor
+{
+   if (out)
+      fclose(out);
+}
+//---------------------------------------------------------------------------
+bool DumpWriter::open(const string& fileName,bool append)
+   // Create the file
+{
+   this->fileName=fileName;
+   if (!append) {
+      if (!(out=fopen(fileName.c_str(),"w"))) {
+         cerr << "unable to write " << fileName << endl;
+         return false;
+      }
+      return true;
+   }
+   // Append a segment. The lock is held until close
+   int fd=::open(fileName.c_str(),O_WRONLY|O_CREAT|O_APPEND,0666);
+   if ((fd<0)||(flock(fd,LOCK_EX)!=0)||(!(out=fdopen(fd,"a")))) {
+      cerr << "unable to append to " << fileName << endl;
+      if (fd>=0) ::close(fd);
+      return false;
+   }
+   // Keep the format of the existing dump
+   format=formatOf(fileName,format);
+   return true;
+}
+//---------------------------------------------------------------------------
+DumpWriter::Format DumpWriter::formatOf(const string& fileName,Format format)
+   // The format of an existing dump
+{
+   int in=::open(fileName.c_str(),O_RDONLY);
+   if (in<0)
+      return format;
+   char magic[sizeof(binaryMagic)];
+   ssize_t len=::read(in,magic,sizeof(magic));
+   ::close(in);
+   if (len<=0)
+      return format;
+   return ((len==static_cast<ssize_t>(sizeof(magic)))&&(memcmp(magic,binaryMagic,sizeof(magic))==0))?Binary:Text;
+}
+//---------------------------------------------------------------------------
+unsigned DumpWriter::intern(const string& s)
+   // Intern a string
+{
+   map<string,unsigned>::iterator iter=strings.find(s);
+   if (iter!=strings.end())
+      return (*iter).second;
+   unsigned id=stringOrder.size();
+   stringOrder.push_back(&((*strings.insert(pair<string,unsigned>(s,id)).first).first));
+   return id;
+}
+//---------------------------------------------------------------------------
+void DumpWriter::header(const string& name,const string& value)
+   // A header entry
+{
+   if (format==Text) {
+      fputs(name.c_str(),out);
+      if (value!="") {
+         fputc(' ',out);
+         fputs(value.c_str(),out);
+      }
+      fputc('\n',out);
+   } else {
+      appendLittleEndian(headers,intern(name),4);
+      appendLittleEndian(headers,intern(value),4);
+   }
+}
+//---------------------------------------------------------------------------
+void DumpWriter::finishFile()
+   // Finish the current file
+{
+   if (currentFile==noString)
+      return;
+   // Use a bitmap if every line was hit completely or not at all
+   bool bitmap=true;
+   for (vector<Line>::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter)
+      if ((((*iter).hits)&&((*iter).hits!=(*iter).hitsPossible))||((*iter).armed!=(*iter).hitsPossible)) {
+         bitmap=false;
+         break;
+      }
+   string values;
+   if (bitmap) {
+      for (vector<Line>::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter)
+         appendVarint(values,(*iter).hitsPossible);
+      string bits((lines.size()+7)/8,0);
+      for (unsigned index=0;index<lines.size();index++)
+         if (lines[index].hits)
+            bits[index/8]|=static_cast<char>(1<<(index%8));
+      values+=bits;
+   } else {
+      for (vector<Line>::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter) {
+         const Line& l=*iter;
+         appendVarint(values,l.hitsPossible);
+         appendVarint(values,l.hits);
+         appendVarint(values,l.armed);
+         if (LineSlots::needed(l.hitsPossible,l.hits,l.armed))
+            values.append(slotBytes,l.slots,2*((l.hitsPossible+7)/8));
+      }
+   }
+   appendLittleEndian(coverage,currentFile,4);
+   appendLittleEndian(coverage,lines.size(),4);
+   appendLittleEndian(coverage,bitmap?BitmapEncoding:SlotEncoding,4);
+   appendLittleEndian(coverage,values.size(),4);
+   for (vector<Line>::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter)
+      appendLittleEndian(coverage,(*iter).lineNo,4);
+   coverage+=values;
+   coverage.append((4-(values.size()&3))&3,0);
+   coverageFiles++;
+   currentFile=noString;
+   lines.clear();
+   slotBytes.clear();
+}
+//---------------------------------------------------------------------------
+void DumpWriter::finishCoverage()
+   // Finish the current coverage section
+{
+   finishFile();
+   string section;
+   appendLittleEndian(section,coverageFiles,4);
+   section+=coverage;
+   sections.push_back(pair<pair<unsigned,unsigned>,string>(pair<unsigned,unsigned>(CoverageSection,coverageName),section));
+   coverage.clear();
+   coverageFiles=0;
+}
+//---------------------------------------------------------------------------
+void DumpWriter::epoch(const string& name)
+   // Start an epoch section
+{
+   if (format==Text) {
+      fprintf(out,"epoch %s\n",name.c_str());
+   } else {
+      finishCoverage();
+      coverageName=intern(name);
+   }
+}
+//---------------------------------------------------------------------------
+void DumpWriter::file(const string& name)
+   // Start a source file
+{
+   if (format==Text) {
+      fprintf(out,"file %s\n",name.c_str());
+   } else {
+      finishFile();
+      currentFile=intern(name);
+   }
+}
+//---------------------------------------------------------------------------
+void DumpWriter::line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots)
+   // A line of the current file. Lines armed or hit partially get the armed count and the hex bitmaps in text
+{
+   bool needed=LineSlots::needed(hitsPossible,hits,armed);
+   if (format==Text) {
+      if (needed) {
+         char buffer[60];
+         snprintf(buffer,sizeof(buffer),"%u %u %u %u ",lineNo,hitsPossible,hits,armed);
+         string text=buffer;
+         appendSlotText(text,slots.armed);
+         text+=' ';
+         appendSlotText(text,slots.hits);
+         text+='\n';
+         fputs(text.c_str(),out);
+      } else {
+         fprintf(out,"%u %u %u\n",lineNo,hitsPossible,hits);
+      }
+   } else {
+      Line l;
+      l.lineNo=lineNo; l.hitsPossible=hitsPossible; l.hits=hits; l.armed=armed; l.slots=slotBytes.size();
+      lines.push_back(l);
+      if (needed) {
+         appendSlotBytes(slotBytes,slots.armed,hitsPossible);
+         appendSlotBytes(slotBytes,slots.hits,hitsPossible);
+      }
+   }
+}
+//---------------------------------------------------------------------------
+void DumpWriter::timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread)
+   // A first hit
+{
+   appendLittleEndian(timelineRecords,fileNo,4);
+   appendLittleEndian(timelineRecords,lineNo,4);
+   appendLittleEndian(timelineRecords,time,8);
+   appendLittleEndian(timelineRecords,thread,4);
+   timelineCount++;
+}
+//---------------------------------------------------------------------------
+bool DumpWriter::close()
+   // Write everything and close the file
+{
+   if (!out)
+      return false;
+   if (format==Text) {
+      // The records end the dump
+      if (timelineCount) {
+         fprintf(out,"timeline %u\n",timelineCount);
+         fwrite(timelineRecords.data(),1,timelineRecords.size(),out);
+      }
+   } else {
+      finishCoverage();
+      string section;
+      appendLittleEndian(section,headers.size()/8,4);
+      section+=headers;
+      sections.insert(sections.begin(),pair<pair<unsigned,unsigned>,string>(pair<unsigned,unsigned>(HeaderSection,noString),section));
+      if (timelineCount) {
+         section.clear();
+         appendLittleEndian(section,timelineCount,4);
+         appendLittleEndian(section,0,4);
+         section+=timelineRecords;
+         sections.push_back(pair<pair<unsigned,unsigned>,string>(pair<unsigned,unsigned>(TimelineSection,noString),section));
+      }
+      // The string table
+      section.clear();
+      appendLittleEndian(section,stringOrder.size(),4);
+      unsigned offset=0;
+      for (vector<const string*>::const_iterator iter=stringOrder.begin(),limit=stringOrder.end();iter!=limit;++iter) {
+         appendLittleEndian(section,offset,4);
+         offset+=(*iter)->size();
+      }
+      appendLittleEndian(section,offset,4);
+      for (vector<const string*>::const_iterator iter=stringOrder.begin(),limit=stringOrder.end();iter!=limit;++iter)
+         section+=*(*iter);
+      sections.insert(sections.begin(),pair<pair<unsigned,unsigned>,string>(pair<unsigned,unsigned>(StringSection,noString),section));
+
+      // The directory, sections are 8 byte aligned
+      string directory(binaryMagic,sizeof(binaryMagic));
+      appendLittleEndian(directory,binaryVersion,4);
+      appendLittleEndian(directory,sections.size(),4);
+      unsigned long long pos=16+24*sections.size();
+      for (vector<pair<pair<unsigned,unsigned>,string> >::const_iterator iter=sections.begin(),limit=sections.end();iter!=limit;++iter) {
+         pos=(pos+7)&~7ull;
+         appendLittleEndian(directory,(*iter).first.first,4);
+         appendLittleEndian(directory,(*iter).first.second,4);
+         appendLittleEndian(directory,pos,8);
+         appendLittleEndian(directory,(*iter).second.size(),8);
+         pos+=(*iter).second.size();
+      }
+      fwrite(directory.data(),1,directory.size(),out);
+      pos=directory.size();
+      for (vector<pair<pair<unsigned,unsigned>,string> >::const_iterator iter=sections.begin(),limit=sections.end();iter!=limit;++iter) {
+         static const char padding[8]={0,0,0,0,0,0,0,0};
+         fwrite(padding,1,((pos+7)&~7ull)-pos,out);
+         pos=(pos+7)&~7ull;
+         fwrite((*iter).second.data(),1,(*iter).second.size(),out);
+         pos+=(*iter).second.size();
+      }
+   }
+   bool ok=(!ferror(out));
+   if (fclose(out)!=0)
+      ok=false;
+   out=0;
+   if (!ok)
+      cerr << "unable to write " << fileName << endl;
+   return ok;
+}
+//---------------------------------------------------------------------------
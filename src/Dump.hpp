@@ -0,0 +1,169 @@
+#ifndef H_Dump
+#define H_Dump
+//---------------------------------------------------------------------------
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+//---------------------------------------------------------------------------
+// A dump is either text or binary. The binary format starts with
+// "BCOVDUMP", a version and a section directory. The sections are a
+// string table, the header entries, one coverage section per epoch
+// (the totals first) and the timeline. A coverage section holds per file
+// a fixed width array of the sorted line numbers, followed by either a
+// bitmap of the hit lines (if every line was hit completely or not at
+// all) or varint encoded counts. Lines armed or hit partially add the
+// bitmaps of their armed and hit addresses. All integers are little
+// endian. Appending runs adds further segments, each a complete dump.
+//---------------------------------------------------------------------------
+/// The number of online cpus, at least 1 and at most 1024. Sizes the worker threads of the tools
+unsigned onlineCpus();
+/// Read an integer in little endian byte order
+unsigned long long readLittleEndian(const unsigned char* data,unsigned bytes);
+/// Append an integer in little endian byte order
+void appendLittleEndian(std::string& out,unsigned long long value,unsigned bytes);
+/// The start value of a FNV-1a hash
+const unsigned long long hashStart=14695981039346656037ull;
+/// Add bytes to a FNV-1a hash
+void hashBytes(unsigned long long& hash,const void* data,unsigned long len);
+/// Read a list of file names, one per line. Empty lines are skipped
+bool readList(const std::string& fileName,std::vector<std::string>& files);
+//---------------------------------------------------------------------------
+/// The armed and the hit addresses of a line. Bit i stands for the i-th address of the line in address order
+struct LineSlots
+{
+   /// A bitmap word
+   typedef unsigned long long Word;
+
+   /// The bitmaps, words(hitsPossible) words each
+   std::vector<Word> armed,hits;
+
+   /// Words of a bitmap
+   static unsigned words(unsigned hitsPossible) { return (hitsPossible+63)/64; }
+   /// Number of bits set
+   static unsigned count(const std::vector<Word>& bits);
+   /// Arm resp. hit the first addresses, for dumps that only give counts
+   void assign(unsigned hitsPossible,unsigned armedCount,unsigned hitCount);
+   /// Add the addresses of a line with the same number of addresses
+   void merge(const LineSlots& other);
+   /// Does a line need the bitmaps, or do the counts describe it?
+   static bool needed(unsigned hitsPossible,unsigned hits,unsigned armed) { return (armed<hitsPossible)||(hits&&(hits<hitsPossible)); }
+};
+//---------------------------------------------------------------------------
+/// Parser for coverage dumps. Derived classes receive the content
+class DumpReader
+{
+   private:
+   /// A line of a text dump, scanned but not interpreted yet
+   struct TextRecord;
+   /// A part of a text dump
+   struct TextChunk;
+
+   /// Scan a part of a text dump, runs in its own thread
+   static void* scanText(void* chunk);
+   /// Interpret the scanned lines
+   void replayText(const TextChunk& chunk,bool& skip,bool& skipEpoch);
+   /// Read a text dump
+   bool readText(const char* data,unsigned long size);
+   /// Read one segment of a binary dump
+   bool readBinary(const unsigned char* data,unsigned long size,unsigned long& used);
+
+   /// The addresses of the current line
+   LineSlots slots;
+
+   public:
+   /// Destructor
+   virtual ~DumpReader();
+
+   /// Read a dump file under a shared lock, appending runs hold an exclusive one. Without lock the caller holds it
+   bool read(const std::string& fileName,bool lock=true);
+
+   protected:
+   /// The start of a segment. Appended runs repeat files and lines, readers merge them
+   virtual void segment();
+   /// A header entry (command, args, date, sample)
+   virtual void header(const std::string& name,const std::string& value);
+   /// The start of an epoch section. Returns false to skip the whole section
+   virtual bool epoch(const std::string& name);
+   /// A new source file. Returns false to skip its lines
+   virtual bool file(const std::string& name)=0;
+   /// A line of the current file. Armed counts the instrumented addresses, slots tells which ones and which were hit
+   virtual void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots)=0;
+   /// A first hit. The file is numbered in the order of the totals
+   virtual void timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread);
+};
+//---------------------------------------------------------------------------
+/// Writer for coverage dumps. Epochs follow the totals, the timeline comes last
+class DumpWriter
+{
+   public:
+   /// The formats
+   enum Format { Text, Binary };
+
+   private:
+   /// A line. The bitmaps of lines needing them start at slots in slotBytes
+   struct Line { unsigned lineNo,hitsPossible,hits,armed,slots; };
+
+   /// The format
+   Format format;
+   /// The file name
+   std::string fileName;
+   /// The text output, written directly
+   FILE* out;
+   /// The string table
+   std::map<std::string,unsigned> strings;
+   /// The strings in order
+   std::vector<const std::string*> stringOrder;
+   /// The finished sections (kind, name, content)
+   std::vector<std::pair<std::pair<unsigned,unsigned>,std::string> > sections;
+   /// The header entries
+   std::string headers;
+   /// The coverage section being built
+   std::string coverage;
+   /// Its name and file count
+   unsigned coverageName,coverageFiles;
+   /// The current file
+   unsigned currentFile;
+   /// Its lines
+   std::vector<Line> lines;
+   /// The armed and hit bitmaps of its lines, as bytes
+   std::string slotBytes;
+   /// The timeline
+   std::string timelineRecords;
+   /// Number of timeline entries
+   unsigned timelineCount;
+
+   /// Intern a string
+   unsigned intern(const std::string& s);
+   /// Finish the current file
+   void finishFile();
+   /// Finish the current coverage section
+   void finishCoverage();
+
+   public:
+   /// Constructor
+   explicit DumpWriter(Format format);
+   /// Destructor
+   ~DumpWriter();
+
+   /// The format of an existing dump, or the given one if the dump is empty or missing
+   static Format formatOf(const std::string& fileName,Format format);
+
+   /// Create the file, or append a segment to it under an exclusive lock
+   bool open(const std::string& fileName,bool append=false);
+   /// Write everything and close the file
+   bool close();
+
+   /// A header entry, before any file
+   void header(const std::string& name,const std::string& value);
+   /// Start an epoch section
+   void epoch(const std::string& name);
+   /// Start a source file
+   void file(const std::string& name);
+   /// A line of the current file. The counts must match the slots
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots);
+   /// A first hit
+   void timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread);
+};
+//---------------------------------------------------------------------------
+#endif
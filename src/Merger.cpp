@@ -0,0 +1,290 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "Merger.hpp"
+#include <algorithm>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+/// Bits per word
+static const unsigned wordBits=FileCoverage::wordBits;
+//---------------------------------------------------------------------------
+unsigned FileCoverage::hits(unsigned slot) const
+   // The merged hits of a line. Complete in any input beats the best partial hits
+{
+   if (full[slot/wordBits]&(1ull<<(slot%wordBits)))
+      return hitsPossible[slot];
+   if (hit[slot/wordBits]&(1ull<<(slot%wordBits))) {
+      map<unsigned,LineSlots>::const_iterator iter=partial.find(slot);
+      if (iter!=partial.end())
+         return LineSlots::count((*iter).second.hits);
+   }
+   return 0;
+}
+//---------------------------------------------------------------------------
+unsigned FileCoverage::hitLines() const
+   // Number of lines hit
+{
+   unsigned result=0;
+   for (vector<Word>::const_iterator iter=hit.begin(),limit=hit.end();iter!=limit;++iter)
+      result+=__builtin_popcountll(*iter);
+   return result;
+}
+//---------------------------------------------------------------------------
+void Merger::extendIndex(FileCoverage& file,const vector<unsigned>& added)
+   // Add lines not seen before to the index of a file. Rare, only inputs from different builds differ
+{
+   vector<unsigned> lines(file.lines.size()+added.size());
+   std::merge(file.lines.begin(),file.lines.end(),added.begin(),added.end(),lines.begin());
+
+   vector<unsigned> hitsPossible(lines.size()),armed(lines.size());
+   vector<FileCoverage::Word> hit((lines.size()+wordBits-1)/wordBits),full(hit.size());
+   map<unsigned,LineSlots> partial;
+   for (unsigned from=0,to=0;from<file.lines.size();from++,to++) {
+      while (lines[to]!=file.lines[from]) to++;
+      hitsPossible[to]=file.hitsPossible[from];
+      armed[to]=file.armed[from];
+      if (file.hit[from/wordBits]&(1ull<<(from%wordBits))) hit[to/wordBits]|=1ull<<(to%wordBits);
+      if (file.full[from/wordBits]&(1ull<<(from%wordBits))) full[to/wordBits]|=1ull<<(to%wordBits);
+      map<unsigned,LineSlots>::iterator iter=file.partial.find(from);
+      if (iter!=file.partial.end()) {
+         partial[to].armed.swap((*iter).second.armed);
+         partial[to].hits.swap((*iter).second.hits);
+      }
+   }
+   file.lines.swap(lines);
+   file.hitsPossible.swap(hitsPossible);
+   file.armed.swap(armed);
+   file.hit.swap(hit);
+   file.full.swap(full);
+   file.partial.swap(partial);
+}
+//---------------------------------------------------------------------------
+void Merger::line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots)
+   // A line of the current file. The bitmaps are kept for lines armed or hit partially
+{
+   Line l={lineNo,hitsPossible,hits,armed,static_cast<unsigned>(pendingSlots.size())};
+   pending.push_back(l);
+   if (LineSlots::needed(hitsPossible,hits,armed)) {
+      pendingSlots.insert(pendingSlots.end(),slots.armed.begin(),slots.armed.end());
+      pendingSlots.insert(pendingSlots.end(),slots.hits.begin(),slots.hits.end());
+   }
+}
+//---------------------------------------------------------------------------
+void Merger::flush()
+   // Merge the pending lines into the current file
+{
+   if ((!currentFile)||pending.empty()) {
+      currentFile=0;
+      pending.clear();
+      pendingSlots.clear();
+      return;
+   }
+   FileCoverage& file=*currentFile;
+   sort(pending.begin(),pending.end(),LineOrder());
+
+   // Lines missing in the index?
+   vector<unsigned> added;
+   vector<unsigned>::const_iterator known=file.lines.begin();
+   for (vector<Line>::const_iterator iter=pending.begin(),limit=pending.end();iter!=limit;++iter) {
+      while ((known!=file.lines.end())&&((*known)<(*iter).lineNo)) ++known;
+      if (((known==file.lines.end())||((*known)!=(*iter).lineNo))&&(added.empty()||(added.back()!=(*iter).lineNo)))
+         added.push_back((*iter).lineNo);
+   }
+   if (!added.empty())
+      extendIndex(file,added);
+
+   // Build the bitsets of this input
+   unsigned words=(file.lines.size()+wordBits-1)/wordBits;
+   hitBits.assign(words,0);
+   fullBits.assign(words,0);
+   unsigned slot=0;
+   for (vector<Line>::const_iterator iter=pending.begin(),limit=pending.end();iter!=limit;++iter) {
+      const Line& l=*iter;
+      while (file.lines[slot]!=l.lineNo) slot++;
+      file.hitsPossible[slot]=max(file.hitsPossible[slot],l.hitsPossible);
+      if (l.hits&&(l.hits>=l.hitsPossible)) {
+         // Complete, the addresses do not matter any more
+         hitBits[slot/wordBits]|=1ull<<(slot%wordBits);
+         fullBits[slot/wordBits]|=1ull<<(slot%wordBits);
+         file.armed[slot]=file.hitsPossible[slot];
+         file.partial.erase(slot);
+         continue;
+      }
+      if (file.full[slot/wordBits]&(1ull<<(slot%wordBits)))
+         continue;
+      map<unsigned,LineSlots>::iterator known=file.partial.find(slot);
+      if ((!LineSlots::needed(l.hitsPossible,l.hits,l.armed))&&(known==file.partial.end())) {
+         file.armed[slot]=max(file.armed[slot],l.armed);
+         continue;
+      }
+
+      // Merge the addresses. Lines without bitmaps so far had the first armed addresses and no hits
+      if (known==file.partial.end()) {
+         known=file.partial.insert(make_pair(slot,LineSlots())).first;
+         (*known).second.assign(file.hitsPossible[slot],file.armed[slot],0);
+      }
+      unsigned words=LineSlots::words(l.hitsPossible);
+      if (LineSlots::needed(l.hitsPossible,l.hits,l.armed)) {
+         lineSlots.armed.assign(pendingSlots.begin()+l.slots,pendingSlots.begin()+l.slots+words);
+         lineSlots.hits.assign(pendingSlots.begin()+l.slots+words,pendingSlots.begin()+l.slots+2*words);
+      } else {
+         lineSlots.assign(l.hitsPossible,l.armed,l.hits);
+      }
+      LineSlots& merged=(*known).second;
+      merged.merge(lineSlots);
+      unsigned hits=LineSlots::count(merged.hits);
+      file.armed[slot]=LineSlots::count(merged.armed);
+      if (hits)
+         hitBits[slot/wordBits]|=1ull<<(slot%wordBits);
+      if (hits>=file.hitsPossible[slot]) {
+         fullBits[slot/wordBits]|=1ull<<(slot%wordBits);
+         file.armed[slot]=file.hitsPossible[slot];
+         file.partial.erase(known);
+      } else if ((!hits)&&(file.armed[slot]>=file.hitsPossible[slot])) {
+         file.partial.erase(known);
+      }
+   }
+
+   // And combine them with the other inputs
+   FileCoverage::Word* hit=&file.hit[0];
+   FileCoverage::Word* full=&file.full[0];
+   const FileCoverage::Word* newHit=&hitBits[0];
+   const FileCoverage::Word* newFull=&fullBits[0];
+   for (unsigned index=0;index<words;index++) {
+      hit[index]|=newHit[index];
+      full[index]|=newFull[index];
+   }
+
+   currentFile=0;
+   pending.clear();
+   pendingSlots.clear();
+}
+//---------------------------------------------------------------------------
+bool Merger::epoch(const string& name)
+   // The start of an epoch section. Epochs of the same name are merged
+{
+   flush();
+   map<string,unsigned>::const_iterator iter=epochSlots.find(name);
+   if (iter==epochSlots.end()) {
+      epochSlots[name]=epochs.size();
+      epochs.push_back(pair<string,Coverage>(name,Coverage()));
+      section=&(epochs.back().second);
+   } else {
+      section=&(epochs[(*iter).second].second);
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool Merger::merge(const string& fileName)
+   // Merge a dump
+{
+   inputs++;
+   section=&totals;
+   bool result=read(fileName);
+   flush();
+   return result;
+}
+//---------------------------------------------------------------------------
+void Merger::mergeCoverage(const Coverage& coverage)
+   // Merge the files of a section of another merger, line by line like a dump
+{
+   LineSlots slots;
+   for (Coverage::const_iterator iter=coverage.begin(),limit=coverage.end();iter!=limit;++iter) {
+      const FileCoverage& other=(*iter).second;
+      if (other.lines.empty()) continue;
+      file((*iter).first);
+      for (unsigned slot=0;slot<other.lines.size();slot++) {
+         map<unsigned,LineSlots>::const_iterator partial=other.partial.find(slot);
+         if (partial==other.partial.end()) {
+            slots.assign(other.hitsPossible[slot],other.armed[slot],other.hits(slot));
+            line(other.lines[slot],other.hitsPossible[slot],other.hits(slot),other.armed[slot],slots);
+         } else {
+            line(other.lines[slot],other.hitsPossible[slot],other.hits(slot),other.armed[slot],(*partial).second);
+         }
+      }
+   }
+   flush();
+}
+//---------------------------------------------------------------------------
+void Merger::merge(const Merger& other)
+   // Merge everything another merger collected
+{
+   flush();
+   if (!inputs)
+      headers=other.headers;
+   inputs+=other.inputs;
+   section=&totals;
+   mergeCoverage(other.totals);
+   for (vector<pair<string,Coverage> >::const_iterator iter=other.epochs.begin(),limit=other.epochs.end();iter!=limit;++iter) {
+      epoch((*iter).first);
+      mergeCoverage((*iter).second);
+   }
+   section=&totals;
+}
+//---------------------------------------------------------------------------
+void Merger::clear()
+   // Forget everything merged so far
+{
+   flush();
+   totals.clear();
+   epochs.clear();
+   headers.clear();
+   epochSlots.clear();
+   section=&totals;
+   inputs=0;
+}
+//---------------------------------------------------------------------------
+static void writeCoverage(DumpWriter& out,const Coverage& coverage)
+   // Write the merged files of a section
+{
+   for (Coverage::const_iterator iter=coverage.begin(),limit=coverage.end();iter!=limit;++iter) {
+      const FileCoverage& file=(*iter).second;
+      if (file.lines.empty()) continue;
+      out.file((*iter).first);
+      LineSlots slots;
+      for (unsigned slot=0;slot<file.lines.size();slot++) {
+         map<unsigned,LineSlots>::const_iterator partial=file.partial.find(slot);
+         if (partial==file.partial.end()) {
+            slots.assign(file.hitsPossible[slot],file.armed[slot],file.hits(slot));
+            out.line(file.lines[slot],file.hitsPossible[slot],file.hits(slot),file.armed[slot],slots);
+         } else {
+            out.line(file.lines[slot],file.hitsPossible[slot],file.hits(slot),file.armed[slot],(*partial).second);
+         }
+      }
+   }
+}
+//---------------------------------------------------------------------------
+bool Merger::write(const string& fileName,DumpWriter::Format format) const
+   // Write the merged dump
+{
+   DumpWriter out(format);
+   if (!out.open(fileName))
+      return false;
+   static const char* const headerNames[]={"command","args","date","sample"};
+   for (unsigned index=0;index<sizeof(headerNames)/sizeof(headerNames[0]);index++) {
+      map<string,string>::const_iterator iter=headers.find(headerNames[index]);
+      if (iter!=headers.end())
+         out.header((*iter).first,(*iter).second);
+   }
+   writeCoverage(out,totals);
+   for (vector<pair<string,Coverage> >::const_iterator iter=epochs.begin(),limit=epochs.end();iter!=limit;++iter) {
+      out.epoch((*iter).first);
+      writeCoverage(out,(*iter).second);
+   }
+   return out.close();
+}
+//---------------------------------------------------------------------------
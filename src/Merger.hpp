@@ -0,0 +1,105 @@
+#ifndef H_Merger
+#define H_Merger
+//---------------------------------------------------------------------------
+#include "Dump.hpp"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+//---------------------------------------------------------------------------
+// Merges many dumps into one. The inputs are read one after the other,
+// so memory depends on the number of distinct lines only
+//---------------------------------------------------------------------------
+/// The merged coverage of a source file
+struct FileCoverage
+{
+   /// A bitset word
+   typedef unsigned long long Word;
+   /// Bits per word
+   static const unsigned wordBits=64;
+
+   /// The sorted line numbers, the index shared by all inputs
+   std::vector<unsigned> lines;
+   /// The possible hits and instrumented addresses of each line
+   std::vector<unsigned> hitsPossible,armed;
+   /// Lines hit at all and lines hit completely in any input
+   std::vector<Word> hit,full;
+   /// The merged addresses of lines armed or hit partially
+   std::map<unsigned,LineSlots> partial;
+
+   /// The merged hits of a line
+   unsigned hits(unsigned slot) const;
+   /// Number of lines hit
+   unsigned hitLines() const;
+};
+//---------------------------------------------------------------------------
+/// The merged coverage of all files of a section
+typedef std::map<std::string,FileCoverage> Coverage;
+//---------------------------------------------------------------------------
+/// Merges dumps into the coverage sections
+class Merger : public DumpReader
+{
+   private:
+   /// A line of the current input file. Lines needing slots have their bitmaps at slots in pendingSlots
+   struct Line { unsigned lineNo,hitsPossible,hits,armed,slots; };
+   /// Order by line number
+   struct LineOrder { bool operator()(const Line& a,const Line& b) const { return a.lineNo<b.lineNo; } };
+
+   /// The position of each epoch
+   std::map<std::string,unsigned> epochSlots;
+   /// The current section
+   Coverage* section;
+   /// The current file
+   FileCoverage* currentFile;
+   /// Its lines in the current input
+   std::vector<Line> pending;
+   /// Their armed and hit bitmaps
+   std::vector<LineSlots::Word> pendingSlots;
+   /// The slots of a pending line
+   LineSlots lineSlots;
+   /// The bitsets of the current input
+   std::vector<FileCoverage::Word> hitBits,fullBits;
+
+   /// Add lines not seen before to the index of a file
+   static void extendIndex(FileCoverage& file,const std::vector<unsigned>& added);
+   /// Merge the pending lines into the current file
+   void flush();
+   /// Merge the files of a section of another merger into the current section
+   void mergeCoverage(const Coverage& coverage);
+
+   protected:
+   /// The start of a segment, beginning with the totals
+   void segment() { flush(); section=&totals; }
+   /// A header entry
+   void header(const std::string& name,const std::string& value) { if ((inputs==1)&&(!headers.count(name))) headers[name]=value; }
+   /// The start of an epoch section
+   bool epoch(const std::string& name);
+   /// A new source file
+   bool file(const std::string& name) { flush(); currentFile=&(*section)[name]; return true; }
+   /// A line of the current file
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots);
+
+   public:
+   /// The totals
+   Coverage totals;
+   /// The epochs in the order they were first seen
+   std::vector<std::pair<std::string,Coverage> > epochs;
+   /// The header entries of the first input
+   std::map<std::string,std::string> headers;
+   /// Number of inputs, the headers are taken from the first one
+   unsigned inputs;
+
+   /// Constructor
+   Merger() : section(&totals),currentFile(0),inputs(0) {}
+
+   /// Merge a dump. A corrupt dump can be merged partially
+   bool merge(const std::string& fileName);
+   /// Merge everything another merger collected, e.g. a dump checked in a scratch merger
+   void merge(const Merger& other);
+   /// Forget everything merged so far
+   void clear();
+   /// Write the merged dump
+   bool write(const std::string& fileName,DumpWriter::Format format) const;
+};
+//---------------------------------------------------------------------------
+#endif
@@ -14,20 +14,246 @@
    along with this program; if not, write to the Free Software
    Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 //---------------------------------------------------------------------------
+#include "ControlSocket.hpp"
 #include "Debugger.hpp"
+#include "DeltaLog.hpp"
+#include "Dump.hpp"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <set>
+#include <cctype>
 #include <cstring>
 #include <cstdlib>
 #include <unistd.h>
+#include <fnmatch.h>
 #include <sys/fcntl.h>
+#include <sys/file.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <libelf.h>
+#include <gelf.h>
 #include <libdwarf.h>
 //---------------------------------------------------------------------------
 using namespace std;
 
+//---------------------------------------------------------------------------
+/// Coverage information about a line
+struct LineCoverage {
+   /// Number of possible hits
+   unsigned hitsPossible;
+   /// Number of encountered hits
+   unsigned hits;
+   /// Number of instrumented addresses
+   unsigned armed;
+   /// Which addresses were instrumented and hit
+   LineSlots slots;
+
+   /// Constructor
+   LineCoverage() : hitsPossible(0),hits(0),armed(0) {}
+};
+/// Coverage of earlier runs per file and line
+typedef map<string,map<unsigned,LineCoverage> > Baseline;
+/// A first hit of an earlier run
+struct TimelineHit
+{
+   /// The file
+   string file;
+   /// The line
+   unsigned lineNo;
+   /// Nanoseconds since the start of its run
+   unsigned long long time;
+   /// The thread
+   unsigned thread;
+};
+//---------------------------------------------------------------------------
+/// Reads a baseline dump
+class BaselineReader : public DumpReader
+{
+   private:
+   /// The target
+   Baseline& baseline;
+   /// The epochs, if wanted
+   vector<pair<string,Baseline> >* epochs;
+   /// The header entries, if wanted
+   map<string,string>* headers;
+   /// The timeline, if wanted
+   vector<TimelineHit>* timelineHits;
+   /// The files of the totals of the current segment, the timeline refers to them by number
+   vector<string> segmentFiles;
+   /// The current section
+   Baseline* current;
+   /// The current file
+   map<unsigned,LineCoverage>* currentFile;
+
+   protected:
+   /// A new segment starts with the totals
+   void segment() { current=&baseline; segmentFiles.clear(); }
+   /// A header entry. The last segment wins
+   void header(const string& name,const string& value) { if (headers) (*headers)[name]=value; }
+   /// The start of an epoch section
+   bool epoch(const string& name) {
+      if (!epochs) return false;
+      vector<pair<string,Baseline> >::iterator iter=epochs->begin(),limit=epochs->end();
+      while ((iter!=limit)&&((*iter).first!=name)) ++iter;
+      if (iter==limit) {
+         epochs->push_back(pair<string,Baseline>(name,Baseline()));
+         iter=epochs->end()-1;
+      }
+      current=&(*iter).second;
+      return true;
+   }
+   /// A new source file
+   bool file(const string& name) {
+      if (current==&baseline) segmentFiles.push_back(name);
+      currentFile=&(*current)[name];
+      return true;
+   }
+   /// A line of the current file. Segments of appended runs are merged address by address
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned /*hits*/,unsigned /*armed*/,const LineSlots& slots) {
+      LineCoverage& l=(*currentFile)[lineNo];
+      l.hitsPossible=max(l.hitsPossible,hitsPossible);
+      l.slots.merge(slots);
+      l.hits=LineSlots::count(l.slots.hits); l.armed=LineSlots::count(l.slots.armed);
+   }
+   /// A first hit
+   void timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread) {
+      if ((!timelineHits)||(fileNo>=segmentFiles.size())) return;
+      TimelineHit hit={segmentFiles[fileNo],lineNo,time,thread};
+      timelineHits->push_back(hit);
+   }
+
+   public:
+   /// Constructor
+   BaselineReader(Baseline& baseline,vector<pair<string,Baseline> >* epochs=0,map<string,string>* headers=0,vector<TimelineHit>* timelineHits=0) : baseline(baseline),epochs(epochs),headers(headers),timelineHits(timelineHits),current(&baseline),currentFile(0) {}
+};
+//---------------------------------------------------------------------------
+static unsigned long long monotonicTime()
+   // The monotonic clock in nanoseconds
+{
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC,&now);
+   return static_cast<unsigned long long>(now.tv_sec)*1000000000ull+now.tv_nsec;
+}
+//---------------------------------------------------------------------------
+/// Timers and counters of bcov itself
+struct Stats
+{
+   /// Number of latency buckets
+   static const unsigned latencyBuckets=20;
+
+   /// The phases and their time in ns, in order
+   vector<pair<string,unsigned long long> > phases;
+   /// Number of handled traps
+   unsigned long traps;
+   /// Time spent handling traps in ns
+   unsigned long long trapTime;
+   /// Trap handling latency, bucket i counts latencies below 2^i us
+   unsigned long trapLatency[latencyBuckets];
+
+   /// Constructor
+   Stats() : traps(0),trapTime(0) { memset(trapLatency,0,sizeof(trapLatency)); }
+
+   /// Add the time since start to a phase. Returns the current time
+   unsigned long long phase(const string& name,unsigned long long start) {
+      unsigned long long now=monotonicTime();
+      for (vector<pair<string,unsigned long long> >::iterator iter=phases.begin(),limit=phases.end();iter!=limit;++iter)
+         if ((*iter).first==name) { (*iter).second+=now-start; return now; }
+      phases.push_back(pair<string,unsigned long long>(name,now-start));
+      return now;
+   }
+   /// Record the handling time of a trap
+   void trap(unsigned long long latency) {
+      traps++; trapTime+=latency;
+      unsigned bucket=0;
+      for (unsigned long long us=latency/1000;us&&(bucket+1<latencyBuckets);us>>=1)
+         bucket++;
+      trapLatency[bucket]++;
+   }
+};
+//---------------------------------------------------------------------------
+/// The first hit of an address
+struct FirstHit {
+   /// The address
+   void* address;
+   /// Nanoseconds since the program start
+   unsigned long long time;
+   /// The thread
+   unsigned thread;
+};
+//---------------------------------------------------------------------------
+/// The (file, line) to breakpoint slot mapping, in the order of the dump
+struct LineIndex
+{
+   /// A source file
+   struct File {
+      /// The name
+      string name;
+      /// Its lines in lineNumbers
+      unsigned firstLine,lineCount;
+   };
+
+   /// The sorted addresses of all lines, one slot each
+   vector<void*> slots;
+   /// The files in dump order
+   vector<File> files;
+   /// The sorted line numbers of all files
+   vector<unsigned> lineNumbers;
+   /// The first entry in lineSlots for each line, plus an end marker
+   vector<unsigned> lineStart;
+   /// The slots of each line
+   vector<unsigned> lineSlots;
+};
+//---------------------------------------------------------------------------
+/// The state of a coverage session
+struct Session
+{
+   /// The command
+   string command;
+   /// The arguments
+   vector<string> args;
+   /// The timestamp
+   string timestamp;
+   /// The sampling parameters, if any
+   string sample;
+   /// The active lines per source file
+   map<string,vector<pair<unsigned,void*> > > activeLines;
+   /// Their breakpoint slots
+   LineIndex index;
+   /// The coverage of earlier runs
+   Baseline baseline;
+   /// The control socket, if any
+   ControlSocket* control;
+   /// The control client being served, if any
+   int controlClient;
+   /// Its unprocessed commands
+   vector<string> controlCommands;
+   /// Its input after the last complete command
+   string controlInput;
+   /// May it send more? Did we answer a command already?
+   bool controlOpen,controlServed;
+   /// The delta log, if any
+   DeltaLog* log;
+   /// The epoch marker breakpoint, if any
+   map<void*,Debugger::BreakpointInfo> epochMarker;
+   /// The name of the current epoch
+   string epochName;
+   /// The addresses hit in each closed epoch
+   vector<pair<string,vector<void*> > > epochs;
+   /// The first hits in order, preallocated
+   vector<FirstHit> timeline;
+   /// The maximum number of recorded first hits
+   unsigned timelineCapacity;
+   /// The program start for the timeline
+   unsigned long long startTime;
+   /// The timers and counters of bcov itself
+   Stats stats;
+   /// The dump format
+   DumpWriter::Format format;
+
+   /// Constructor
+   Session() : control(0),controlClient(-1),controlOpen(false),controlServed(false),log(0),epochName("initial"),timelineCapacity(0),startTime(0),format(DumpWriter::Binary) {}
+};
 //---------------------------------------------------------------------------
 static void dwarfErrorHandler(Dwarf_Error error, Dwarf_Ptr /*userData*/)
    // Show the dwarf error message
@@ -112,7 +338,79 @@ static string normalize(const string& filePath)
    return result;
 }
 //---------------------------------------------------------------------------
-static bool readDwarfLineNumbers(const string& fileName,map<string,vector<pair<unsigned,void*> > >& lines, unsigned long base)
+/// Include and exclude rules for the instrumented source files
+class PathFilter
+{
+   private:
+   /// The rules, true marks an include rule
+   vector<pair<string,bool> > rules;
+   /// Do we have include rules?
+   bool hasIncludes;
+
+   /// Does a rule match?
+   static bool matchRule(const string& rule,const string& path);
+
+   public:
+   /// Constructor
+   PathFilter() : hasIncludes(false) {}
+
+   /// Add an include rule
+   void include(const string& pattern);
+   /// Add an exclude rule
+   void exclude(const string& pattern);
+   /// Should the file be instrumented?
+   bool accepts(const string& path) const;
+};
+//---------------------------------------------------------------------------
+static string rulePattern(const char* pattern)
+   // Resolve non-glob patterns like bcov-report does
+{
+   if (strpbrk(pattern,"*?["))
+      return pattern;
+   char* path=realpath(pattern,0l);
+   if (!path)
+      return pattern;
+   string result=path;
+   free(path);
+   return result;
+}
+//---------------------------------------------------------------------------
+void PathFilter::include(const string& pattern)
+   // Add an include rule
+{
+   rules.push_back(pair<string,bool>(pattern,true));
+   hasIncludes=true;
+}
+//---------------------------------------------------------------------------
+void PathFilter::exclude(const string& pattern)
+   // Add an exclude rule
+{
+   rules.push_back(pair<string,bool>(pattern,false));
+}
+//---------------------------------------------------------------------------
+bool PathFilter::matchRule(const string& rule,const string& path)
+   // Does a rule match? Globs use fnmatch, everything else is a prefix
+{
+   if (rule.find_first_of("*?[")!=string::npos)
+      return fnmatch(rule.c_str(),path.c_str(),0)==0;
+   return path.compare(0,rule.length(),rule)==0;
+}
+//---------------------------------------------------------------------------
+bool PathFilter::accepts(const string& path) const
+   // Should the file be instrumented?
+{
+   bool included=!hasIncludes;
+   for (vector<pair<string,bool> >::const_iterator iter=rules.begin(),limit=rules.end();iter!=limit;++iter) {
+      if ((*iter).second) {
+         if ((!included)&&matchRule((*iter).first,path))
+            included=true;
+      } else if (matchRule((*iter).first,path))
+         return false;
+   }
+   return included;
+}
+//---------------------------------------------------------------------------
+static bool readDwarfLineNumbers(const string& fileName,map<string,vector<pair<unsigned,void*> > >& lines, unsigned long base,const PathFilter& filter)
    // Return the line numbers from dwarf informations
 {
    // Open The file
@@ -125,6 +423,10 @@ static bool readDwarfLineNumbers(const string& fileName,map<string,vector<pair<u
    if (status==DW_DLV_ERROR) { close(fd); return false; }
    if (status==DW_DLV_NO_ENTRY) { close(fd); return true; }
 
+   // The interned source files, null when filtered out. Each distinct name
+   // is normalized and checked only once, not once per line entry
+   map<string,vector<pair<unsigned,void*> >*> sources;
+
    // Iterator over the headers
    Dwarf_Unsigned header;
    while (dwarf_next_cu_header(dbg,0,0,0,0,&header,0)==DW_DLV_OK) {
@@ -155,7 +457,13 @@ static bool readDwarfLineNumbers(const string& fileName,map<string,vector<pair<u
             return false;
 
          if (lineNo&&isCode) {
-            lines[normalize(lineSource)].push_back(pair<unsigned,void*>(lineNo,reinterpret_cast<void*>(addr+base)));
+            map<string,vector<pair<unsigned,void*> >*>::iterator source=sources.find(lineSource);
+            if (source==sources.end()) {
+               string path=normalize(lineSource);
+               source=sources.insert(pair<string,vector<pair<unsigned,void*> >*>(lineSource,filter.accepts(path)?&lines[path]:0)).first;
+            }
+            if ((*source).second)
+               (*source).second->push_back(pair<unsigned,void*>(lineNo,reinterpret_cast<void*>(addr+base)));
          }
 
          dwarf_dealloc(dbg,lineSource,DW_DLA_STRING);
@@ -175,6 +483,97 @@ static bool readDwarfLineNumbers(const string& fileName,map<string,vector<pair<u
    return true;
 }
 //---------------------------------------------------------------------------
+static void* findFunction(const string& fileName,const string& name)
+   // Find the address of a function in the symbol table
+{
+   int fd=open(fileName.c_str(),O_RDONLY);
+   if (fd<0) return 0;
+
+   void* result=0;
+   elf_version(EV_CURRENT);
+   Elf* elf=elf_begin(fd,ELF_C_READ,0);
+   if (elf) {
+      for (Elf_Scn* scn=elf_nextscn(elf,0);scn&&(!result);scn=elf_nextscn(elf,scn)) {
+         GElf_Shdr shdr;
+         if ((!gelf_getshdr(scn,&shdr))||((shdr.sh_type!=SHT_SYMTAB)&&(shdr.sh_type!=SHT_DYNSYM))||(!shdr.sh_entsize))
+            continue;
+         Elf_Data* data=elf_getdata(scn,0);
+         if (!data) continue;
+         for (unsigned index=0,count=shdr.sh_size/shdr.sh_entsize;index<count;index++) {
+            GElf_Sym sym;
+            if ((!gelf_getsym(data,index,&sym))||(GELF_ST_TYPE(sym.st_info)!=STT_FUNC)||(!sym.st_value))
+               continue;
+            const char* symName=elf_strptr(elf,shdr.sh_link,sym.st_name);
+            if (symName&&(name==symName)) {
+               result=reinterpret_cast<void*>(sym.st_value);
+               break;
+            }
+         }
+      }
+      elf_end(elf);
+   }
+   close(fd);
+   return result;
+}
+//---------------------------------------------------------------------------
+static bool readInputList(const string& fileName,vector<string>& inputs)
+   // Read the list of fork server inputs, one file per line
+{
+   ifstream in(fileName.c_str());
+   if (!in.is_open()) {
+      cerr << "unable to read " << fileName << endl;
+      return false;
+   }
+   string line;
+   while (getline(in,line))
+      if (line.length())
+         inputs.push_back(line);
+   return true;
+}
+//---------------------------------------------------------------------------
+static bool readJobs(const string& fileName,vector<vector<string> >& jobs)
+   // Read the job file, the arguments of one run per line separated by blanks
+{
+   ifstream in(fileName.c_str());
+   if (!in.is_open()) {
+      cerr << "unable to read " << fileName << endl;
+      return false;
+   }
+   string line;
+   while (getline(in,line)) {
+      if ((!line.length())||(line[0]=='#'))
+         continue;
+      vector<string> args;
+      for (string::size_type pos=line.find_first_not_of(" \t");pos!=string::npos;) {
+         string::size_type end=line.find_first_of(" \t",pos);
+         args.push_back(line.substr(pos,(end==string::npos)?string::npos:(end-pos)));
+         pos=(end==string::npos)?end:line.find_first_not_of(" \t",end);
+      }
+      jobs.push_back(args);
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+static bool stageInput(int fd,const string& fileName)
+   // Copy the next input into the file shared with the fork server
+{
+   int in=open(fileName.c_str(),O_RDONLY);
+   if (in<0) return false;
+   if (ftruncate(fd,0)!=0) { close(in); return false; }
+   char buffer[65536];
+   off_t ofs=0;
+   while (true) {
+      ssize_t len=read(in,buffer,sizeof(buffer));
+      if (len<=0) break;
+      if (pwrite(fd,buffer,len,ofs)!=len) { close(in); return false; }
+      ofs+=len;
+   }
+   close(in);
+   // The offset is shared with the stdin of the forked children
+   lseek(fd,0,SEEK_SET);
+   return true;
+}
+//---------------------------------------------------------------------------
 static string escapeString(const string& s)
    // Escape string characters
 {
@@ -191,48 +590,550 @@ static string escapeString(const string& s)
    return result;
 }
 //---------------------------------------------------------------------------
-static bool dumpResult(const string& outputfile,const string& command,const vector<string>& args,const string& timestamp,const map<string,vector<pair<unsigned,void*> > >& activeLines,const map<void*,Debugger::BreakpointInfo>& activeAddresses)
-   // Dump the results into a file
+static string unescapeString(const string& s)
+   // Undo escapeString
 {
-   ofstream out(outputfile.c_str());
-   if (!out.is_open()) {
-      cerr << "unable to write " << outputfile << endl;
-      return false;
+   string result;
+   for (string::const_iterator iter=s.begin(),limit=s.end();iter!=limit;++iter) {
+      char c=(*iter);
+      if ((c=='\\')&&((iter+1)!=limit)) {
+         c=*(++iter);
+         if (c=='n') c='\n';
+      }
+      result+=c;
    }
-   // Write the command information
-   out << "command " << escapeString(command) << endl;
-   out << "args";
-   for (vector<string>::const_iterator iter=args.begin(),limit=args.end();iter!=limit;++iter)
-      out << " " << escapeString(*iter);
-   out << endl;
-   out << "date " << timestamp << endl;
-   // Process the files
-   map<void*,Debugger::BreakpointInfo>::const_iterator limit4=activeAddresses.end();
+   return result;
+}
+//---------------------------------------------------------------------------
+static void buildIndex(Session& session)
+   // Compute the breakpoint slots of every line once
+{
+   const map<string,vector<pair<unsigned,void*> > >& activeLines=session.activeLines;
+   LineIndex& index=session.index;
+   index=LineIndex();
+   // One slot per address
+   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=activeLines.begin(),limit=activeLines.end();iter!=limit;++iter)
+      for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
+         index.slots.push_back((*iter2).second);
+   sort(index.slots.begin(),index.slots.end());
+   index.slots.erase(unique(index.slots.begin(),index.slots.end()),index.slots.end());
+   // The lines of each file in dump order
+   vector<pair<unsigned,unsigned> > lines;
    for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=activeLines.begin(),limit=activeLines.end();iter!=limit;++iter) {
-      // Construct mapped represenation
-      map<unsigned,set<void*> > addressesPerLine;
+      lines.clear();
       for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
-         addressesPerLine[(*iter2).first].insert((*iter2).second);
-      // Write hit info
-      out << "file " << (*iter).first << endl;
-      for (map<unsigned,set<void*> >::const_iterator iter2=addressesPerLine.begin(),limit2=addressesPerLine.end();iter2!=limit2;++iter2) {
-         // Count the hits
-         unsigned hits=0;
-         for (set<void*>::const_iterator iter3=(*iter2).second.begin(),limit3=(*iter2).second.end();iter3!=limit3;++iter3) {
-            map<void*,Debugger::BreakpointInfo>::const_iterator iter4=activeAddresses.find(*iter3);
-            if (iter4==limit4) continue;
-            if ((*iter4).second.hits) hits++;
+         lines.push_back(pair<unsigned,unsigned>((*iter2).first,lower_bound(index.slots.begin(),index.slots.end(),(*iter2).second)-index.slots.begin()));
+      sort(lines.begin(),lines.end());
+      lines.erase(unique(lines.begin(),lines.end()),lines.end());
+      LineIndex::File file;
+      file.name=(*iter).first;
+      file.firstLine=index.lineNumbers.size();
+      for (vector<pair<unsigned,unsigned> >::const_iterator iter2=lines.begin(),limit2=lines.end();iter2!=limit2;++iter2) {
+         if ((iter2==lines.begin())||((*iter2).first!=index.lineNumbers.back())) {
+            index.lineNumbers.push_back((*iter2).first);
+            index.lineStart.push_back(index.lineSlots.size());
          }
-         // Write the status line
-         out << (*iter2).first << " " << (*iter2).second.size() << " " << hits << endl;
+         index.lineSlots.push_back((*iter2).second);
+      }
+      file.lineCount=index.lineNumbers.size()-file.firstLine;
+      index.files.push_back(file);
+   }
+   index.lineStart.push_back(index.lineSlots.size());
+}
+//---------------------------------------------------------------------------
+static void markSlots(const LineIndex& index,const map<void*,Debugger::BreakpointInfo>& addresses,vector<unsigned char>& state)
+   // The state of each slot: 0 not armed, 1 armed, 2 hit. Both sides are sorted
+{
+   state.assign(index.slots.size(),0);
+   vector<void*>::const_iterator slot=index.slots.begin(),slotLimit=index.slots.end();
+   for (map<void*,Debugger::BreakpointInfo>::const_iterator iter=addresses.begin(),limit=addresses.end();(iter!=limit)&&(slot!=slotLimit);++iter) {
+      while ((slot!=slotLimit)&&((*slot)<(*iter).first))
+         ++slot;
+      if ((slot!=slotLimit)&&((*slot)==(*iter).first))
+         state[slot-index.slots.begin()]=(*iter).second.hits?2:1;
+   }
+}
+//---------------------------------------------------------------------------
+static void markSlots(const LineIndex& index,const vector<void*>& hits,vector<unsigned char>& state)
+   // The state of each slot for sorted hit addresses
+{
+   state.assign(index.slots.size(),0);
+   vector<void*>::const_iterator slot=index.slots.begin(),slotLimit=index.slots.end();
+   for (vector<void*>::const_iterator iter=hits.begin(),limit=hits.end();(iter!=limit)&&(slot!=slotLimit);++iter) {
+      while ((slot!=slotLimit)&&((*slot)<(*iter)))
+         ++slot;
+      if ((slot!=slotLimit)&&((*slot)==(*iter)))
+         state[slot-index.slots.begin()]=2;
+   }
+}
+//---------------------------------------------------------------------------
+static void dumpFile(DumpWriter& out,const string& fileName,const map<unsigned,LineCoverage>& lines)
+   // Write the hit info of a file only known from the baseline
+{
+   out.file(fileName);
+   for (map<unsigned,LineCoverage>::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter)
+      out.line((*iter).first,(*iter).second.hitsPossible,(*iter).second.hits,(*iter).second.armed,(*iter).second.slots);
+}
+//---------------------------------------------------------------------------
+static void dumpFile(DumpWriter& out,const LineIndex& index,const LineIndex::File& file,const vector<unsigned char>& state,const map<unsigned,LineCoverage>* baseline)
+   // Write the hit info of a file, merged with the baseline address by address. Addresses hit there had no breakpoints
+{
+   static const map<unsigned,LineCoverage> noBaseline;
+   if (!baseline) baseline=&noBaseline;
+   map<unsigned,LineCoverage>::const_iterator base=baseline->begin(),baseLimit=baseline->end();
+
+   out.file(file.name);
+   LineSlots slots;
+   for (unsigned line=file.firstLine,limit=file.firstLine+file.lineCount;line<limit;line++) {
+      unsigned lineNo=index.lineNumbers[line];
+      for (;(base!=baseLimit)&&((*base).first<lineNo);++base)
+         out.line((*base).first,(*base).second.hitsPossible,(*base).second.hits,(*base).second.armed,(*base).second.slots);
+      // The slots of a line are its addresses in ascending order
+      unsigned hitsPossible=index.lineStart[line+1]-index.lineStart[line];
+      slots.armed.assign(LineSlots::words(hitsPossible),0);
+      slots.hits.assign(LineSlots::words(hitsPossible),0);
+      for (unsigned slot=index.lineStart[line],slotLimit=index.lineStart[line+1];slot<slotLimit;slot++) {
+         unsigned char s=state[index.lineSlots[slot]];
+         unsigned bit=slot-index.lineStart[line];
+         if (s) slots.armed[bit/64]|=1ull<<(bit%64);
+         if (s==2) slots.hits[bit/64]|=1ull<<(bit%64);
+      }
+      // A baseline line of another build has other addresses, it is dropped
+      if ((base!=baseLimit)&&((*base).first==lineNo)) {
+         if ((*base).second.hitsPossible==hitsPossible)
+            slots.merge((*base).second.slots);
+         ++base;
+      }
+      out.line(lineNo,hitsPossible,LineSlots::count(slots.hits),LineSlots::count(slots.armed),slots);
+   }
+   for (;base!=baseLimit;++base)
+      out.line((*base).first,(*base).second.hitsPossible,(*base).second.hits,(*base).second.armed,(*base).second.slots);
+}
+//---------------------------------------------------------------------------
+static void dumpTimeline(DumpWriter& out,const Session& session,const Baseline& baseline)
+   // Write the first hits with the file numbered in the order of the dump
+{
+   // Number the files in the order of the dump
+   set<string> fileNames;
+   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=session.activeLines.begin(),limit=session.activeLines.end();iter!=limit;++iter)
+      fileNames.insert((*iter).first);
+   for (Baseline::const_iterator iter=baseline.begin(),limit=baseline.end();iter!=limit;++iter)
+      fileNames.insert((*iter).first);
+   map<string,unsigned> fileNumbers;
+   unsigned fileCount=0;
+   for (set<string>::const_iterator iter=fileNames.begin(),limit=fileNames.end();iter!=limit;++iter)
+      fileNumbers[*iter]=fileCount++;
+   // Find the line of each recorded address
+   map<void*,pair<unsigned,unsigned> > positions;
+   for (vector<FirstHit>::const_iterator iter=session.timeline.begin(),limit=session.timeline.end();iter!=limit;++iter)
+      positions[(*iter).address];
+   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=session.activeLines.begin(),limit=session.activeLines.end();iter!=limit;++iter) {
+      unsigned fileNo=fileNumbers[(*iter).first];
+      for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2) {
+         map<void*,pair<unsigned,unsigned> >::iterator pos=positions.find((*iter2).second);
+         if (pos!=positions.end())
+            (*pos).second=pair<unsigned,unsigned>(fileNo,(*iter2).first);
+      }
+   }
+   for (vector<FirstHit>::const_iterator iter=session.timeline.begin(),limit=session.timeline.end();iter!=limit;++iter) {
+      const pair<unsigned,unsigned>& pos=positions[(*iter).address];
+      out.timeline(pos.first,pos.second,(*iter).time,(*iter).thread);
+   }
+}
+//---------------------------------------------------------------------------
+static bool dumpResult(const string& outputfile,const Session& session,const map<void*,Debugger::BreakpointInfo>& activeAddresses,bool withBaseline,bool append=false)
+   // Dump the results into a file, optionally merged with the baseline or appended as a segment
+{
+   static const Baseline noBaseline;
+   const Baseline& baseline=withBaseline?session.baseline:noBaseline;
+
+   DumpWriter out(session.format);
+   if (!out.open(outputfile,append))
+      return false;
+   // Write the command information
+   out.header("command",escapeString(session.command));
+   string args;
+   for (vector<string>::const_iterator iter=session.args.begin(),limit=session.args.end();iter!=limit;++iter)
+      args+=((iter==session.args.begin())?"":" ")+escapeString(*iter);
+   out.header("args",args);
+   string timestamp=session.timestamp;
+   if (timestamp.length()&&(timestamp[timestamp.length()-1]=='\n'))
+      timestamp.resize(timestamp.length()-1);
+   out.header("date",timestamp);
+   if (session.sample!="")
+      out.header("sample",session.sample);
+   // Process the files in the order of the index
+   const LineIndex& index=session.index;
+   vector<unsigned char> state;
+   markSlots(index,activeAddresses,state);
+   Baseline::const_iterator base=baseline.begin(),baseLimit=baseline.end();
+   for (vector<LineIndex::File>::const_iterator iter=index.files.begin(),limit=index.files.end();iter!=limit;++iter) {
+      // Files known only from the baseline
+      for (;(base!=baseLimit)&&((*base).first<(*iter).name);++base)
+         dumpFile(out,(*base).first,(*base).second);
+      const map<unsigned,LineCoverage>* baseLines=0;
+      if ((base!=baseLimit)&&((*base).first==(*iter).name))
+         baseLines=&(*(base++)).second;
+      dumpFile(out,index,*iter,state,baseLines);
+   }
+   for (;base!=baseLimit;++base)
+      dumpFile(out,(*base).first,(*base).second);
+
+   // Write the epochs, each with the files it touched. Everything counts as armed
+   for (vector<pair<string,vector<void*> > >::const_iterator iter=session.epochs.begin(),limit=session.epochs.end();iter!=limit;++iter) {
+      out.epoch((*iter).first);
+      markSlots(index,(*iter).second,state);
+      for (vector<unsigned char>::iterator iter2=state.begin(),limit2=state.end();iter2!=limit2;++iter2)
+         if (!(*iter2)) (*iter2)=1;
+      for (vector<LineIndex::File>::const_iterator iter2=index.files.begin(),limit2=index.files.end();iter2!=limit2;++iter2) {
+         bool touched=false;
+         for (unsigned slot=index.lineStart[(*iter2).firstLine],slotLimit=index.lineStart[(*iter2).firstLine+(*iter2).lineCount];(slot<slotLimit)&&(!touched);slot++)
+            touched=(state[index.lineSlots[slot]]==2);
+         if (touched)
+            dumpFile(out,index,*iter2,state,0);
       }
    }
+   if (!session.timeline.empty())
+      dumpTimeline(out,session,baseline);
 
+   return out.close();
+}
+//---------------------------------------------------------------------------
+static bool sampled(void* address,double fraction,unsigned seed)
+   // Is the address part of the sample? Deterministic for a given seed
+{
+   if (fraction>=1)
+      return true;
+   // splitmix64 finalizer
+   unsigned long long x=reinterpret_cast<unsigned long>(address)+0x9E3779B97F4A7C15ull*(seed+1ull);
+   x=(x^(x>>30))*0xBF58476D1CE4E5B9ull;
+   x=(x^(x>>27))*0x94D049BB133111EBull;
+   x^=x>>31;
+   return (x>>11)*(1.0/9007199254740992.0)<fraction;
+}
+//---------------------------------------------------------------------------
+static void collectAddresses(const map<string,vector<pair<unsigned,void*> > >& lines,const Baseline& baseline,double fraction,unsigned seed,map<void*,Debugger::BreakpointInfo>& addresses)
+   // Collect the sampled addresses not hit in the baseline
+{
+   Baseline::const_iterator limit3=baseline.end();
+   vector<pair<unsigned,void*> > fileLines;
+   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter) {
+      Baseline::const_iterator covered=baseline.find((*iter).first);
+      // The slots of a line are its addresses in ascending order, like in the dump
+      fileLines=(*iter).second;
+      sort(fileLines.begin(),fileLines.end());
+      fileLines.erase(unique(fileLines.begin(),fileLines.end()),fileLines.end());
+      for (vector<pair<unsigned,void*> >::const_iterator iter2=fileLines.begin(),limit2=fileLines.end();iter2!=limit2;) {
+         vector<pair<unsigned,void*> >::const_iterator lineEnd=iter2;
+         while ((lineEnd!=limit2)&&((*lineEnd).first==(*iter2).first))
+            ++lineEnd;
+         const LineCoverage* base=0;
+         if (covered!=limit3) {
+            map<unsigned,LineCoverage>::const_iterator line=(*covered).second.find((*iter2).first);
+            if ((line!=(*covered).second.end())&&((*line).second.hitsPossible==static_cast<unsigned>(lineEnd-iter2)))
+               base=&(*line).second;
+         }
+         for (unsigned slot=0;iter2!=lineEnd;++iter2,++slot) {
+            if (base&&(slot/64<base->slots.hits.size())&&((base->slots.hits[slot/64]>>(slot%64))&1))
+               continue;
+            if (sampled((*iter2).second,fraction,seed))
+               addresses[(*iter2).second];
+         }
+      }
+   }
+}
+//---------------------------------------------------------------------------
+static bool logHeader(DeltaLog& log,const Session& session)
+   // Write the command information into the delta log
+{
+   string header="command "+escapeString(session.command)+"\n";
+   for (vector<string>::const_iterator iter=session.args.begin(),limit=session.args.end();iter!=limit;++iter)
+      header+="arg "+escapeString(*iter)+"\n";
+   string timestamp=session.timestamp;
+   if (timestamp.length()&&(timestamp[timestamp.length()-1]=='\n'))
+      timestamp.resize(timestamp.length()-1);
+   header+="date "+timestamp+"\n";
+   if (session.sample!="")
+      header+="sample "+session.sample+"\n";
+   return log.append(header);
+}
+//---------------------------------------------------------------------------
+static bool logLines(DeltaLog& log,const map<string,vector<pair<unsigned,void*> > >& lines,const map<void*,Debugger::BreakpointInfo>& addresses)
+   // Write the line table and the armed addresses into the delta log
+{
+   string records;
+   char buffer[32];
+   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=lines.begin(),limit=lines.end();iter!=limit;++iter) {
+      records+="file "+(*iter).first+"\n";
+      for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2) {
+         snprintf(buffer,sizeof(buffer),"%u %lx\n",(*iter2).first,reinterpret_cast<unsigned long>((*iter2).second));
+         records+=buffer;
+      }
+   }
+   unsigned count=0;
+   for (map<void*,Debugger::BreakpointInfo>::const_iterator iter=addresses.begin(),limit=addresses.end();iter!=limit;++iter,++count) {
+      snprintf(buffer,sizeof(buffer),"%s%lx",(count%64)?" ":(count?"\narmed ":"armed "),reinterpret_cast<unsigned long>((*iter).first));
+      records+=buffer;
+   }
+   if (count)
+      records+="\n";
+   return log.append(records);
+}
+//---------------------------------------------------------------------------
+static bool compactLog(const string& logFile,const string& outputfile,Session& session)
+   // Turn a delta log into a dump
+{
+   ifstream in(logFile.c_str());
+   if (!in.is_open()) {
+      cerr << "unable to read " << logFile << endl;
+      return false;
+   }
+   map<void*,Debugger::BreakpointInfo> addresses;
+   vector<pair<unsigned,void*> >* currentFile=0;
+   string line;
+   while (getline(in,line)) {
+      if (line.compare(0,8,"command ")==0) { session.command=unescapeString(line.substr(8)); continue; }
+      if (line.compare(0,4,"arg ")==0) { session.args.push_back(unescapeString(line.substr(4))); continue; }
+      if (line.compare(0,5,"date ")==0) { session.timestamp=line.substr(5); continue; }
+      if (line.compare(0,7,"sample ")==0) { session.sample=line.substr(7); continue; }
+      if (line.compare(0,5,"file ")==0) { currentFile=&session.activeLines[line.substr(5)]; continue; }
+      const char* pos=line.c_str();
+      char* next;
+      if (line.compare(0,6,"armed ")==0) {
+         for (pos+=6;;pos=next) {
+            void* addr=reinterpret_cast<void*>(strtoul(pos,&next,16));
+            if (next==pos) break;
+            addresses[addr];
+         }
+      } else if (line.compare(0,5,"hits ")==0) {
+         strtoul(pos+5,&next,10);
+         for (pos=next;;pos=next) {
+            void* addr=reinterpret_cast<void*>(strtoul(pos,&next,16));
+            if (next==pos) break;
+            addresses[addr].hits++;
+         }
+      } else if (currentFile) {
+         unsigned lineNo=strtoul(pos,&next,10);
+         if (next==pos) continue;
+         void* addr=reinterpret_cast<void*>(strtoul(pos=next,&next,16));
+         if (next==pos) continue;
+         currentFile->push_back(pair<unsigned,void*>(lineNo,addr));
+      }
+   }
+   buildIndex(session);
+   return dumpResult(outputfile,session,addresses,true);
+}
+//---------------------------------------------------------------------------
+static void recordEpoch(Session& session,const map<void*,Debugger::BreakpointInfo>& addrs)
+   // Record the hits of the current epoch
+{
+   vector<void*> hit;
+   for (map<void*,Debugger::BreakpointInfo>::const_iterator iter=addrs.begin(),limit=addrs.end();iter!=limit;++iter)
+      if ((*iter).second.hits)
+         hit.push_back((*iter).first);
+   session.epochs.push_back(pair<string,vector<void*> >(session.epochName,hit));
+}
+//---------------------------------------------------------------------------
+static bool compactDump(const string& fileName)
+   // Merge the segments of appended runs in place, holding the lock appending takes. The format stays
+{
+   int fd=open(fileName.c_str(),O_RDWR);
+   if ((fd<0)||(flock(fd,LOCK_EX)!=0)) {
+      cerr << "unable to lock " << fileName << endl;
+      if (fd>=0) close(fd);
+      return false;
+   }
+   Baseline totals;
+   vector<pair<string,Baseline> > epochs;
+   map<string,string> headers;
+   vector<TimelineHit> timelineHits;
+   if (!BaselineReader(totals,&epochs,&headers,&timelineHits).read(fileName,false)) {
+      close(fd);
+      return false;
+   }
+   // Write the merged dump into a temporary file first
+   string tempName=fileName+".compact";
+   DumpWriter out(DumpWriter::formatOf(fileName,DumpWriter::Binary));
+   if (!out.open(tempName)) {
+      close(fd);
+      return false;
+   }
+   static const char* const headerNames[]={"command","args","date","sample"};
+   for (unsigned index=0;index<sizeof(headerNames)/sizeof(headerNames[0]);index++)
+      if (headers.count(headerNames[index]))
+         out.header(headerNames[index],headers[headerNames[index]]);
+   for (Baseline::const_iterator iter=totals.begin(),limit=totals.end();iter!=limit;++iter)
+      dumpFile(out,(*iter).first,(*iter).second);
+   for (vector<pair<string,Baseline> >::const_iterator iter=epochs.begin(),limit=epochs.end();iter!=limit;++iter) {
+      out.epoch((*iter).first);
+      for (Baseline::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
+         dumpFile(out,(*iter2).first,(*iter2).second);
+   }
+   // The timelines of the runs follow each other, renumbered to the merged files
+   map<string,unsigned> fileNumbers;
+   unsigned fileCount=0;
+   for (Baseline::const_iterator iter=totals.begin(),limit=totals.end();iter!=limit;++iter)
+      fileNumbers[(*iter).first]=fileCount++;
+   for (vector<TimelineHit>::const_iterator iter=timelineHits.begin(),limit=timelineHits.end();iter!=limit;++iter)
+      out.timeline(fileNumbers[(*iter).file],(*iter).lineNo,(*iter).time,(*iter).thread);
+   bool ok=out.close();
+   // And replace the content, the file itself stays as others might wait for the lock
+   int in=ok?open(tempName.c_str(),O_RDONLY):-1;
+   if ((ok=(in>=0)&&(ftruncate(fd,0)==0)&&(lseek(fd,0,SEEK_SET)==0))) {
+      char buffer[65536];
+      for (ssize_t len;ok&&((len=read(in,buffer,sizeof(buffer)))>0);)
+         ok=(write(fd,buffer,len)==len);
+   }
+   if (in>=0) close(in);
+   unlink(tempName.c_str());
+   if (!ok)
+      cerr << "unable to write " << fileName << endl;
+   close(fd);
+   return ok;
+}
+//---------------------------------------------------------------------------
+static bool closeEpoch(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs,const string& next)
+   // Record the hits of the current epoch and re-arm them for the next one. Needs a stopped program
+{
+   if (!dbg.isStopped())
+      return false;
+   recordEpoch(session,addrs);
+   dbg.rearmBreakpoints(addrs);
+   // The name ends the dump line
+   session.epochName=next;
+   for (string::iterator iter=session.epochName.begin(),limit=session.epochName.end();iter!=limit;++iter)
+      if (((*iter)=='\n')||((*iter)=='\r'))
+         (*iter)=' ';
+   if (session.epochName.find_first_not_of(" \t")==string::npos) {
+      char buffer[20];
+      snprintf(buffer,sizeof(buffer),"%u",static_cast<unsigned>(session.epochs.size()));
+      session.epochName=buffer;
+   }
    return true;
 }
 //---------------------------------------------------------------------------
-static bool runDebugger(Debugger& dbg,map<void*,Debugger::BreakpointInfo>& addrs)
-   // run to the next breakpoint
+static void processControl(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs)
+   // Execute the pending control commands
+{
+   if (session.controlClient<0)
+      return;
+   while (!session.controlCommands.empty()) {
+      const string& command=session.controlCommands.front();
+      string result="ok";
+      if (command=="start") {
+         dbg.setActive(true);
+      } else if (command=="stop") {
+         dbg.setActive(false);
+      } else if (command.compare(0,9,"snapshot ")==0) {
+         if (!dumpResult(command.substr(9),session,addrs,true))
+            result="error unable to write "+command.substr(9);
+      } else if (command=="reset") {
+         // Needs a stopped program, we continue once the interrupt arrived
+         if (!dbg.rearmBreakpoints(addrs)) {
+            if (dbg.interrupt())
+               return;
+            result="error unable to stop the program";
+         }
+      } else if (command.compare(0,6,"epoch ")==0) {
+         // Likewise
+         if (!closeEpoch(dbg,session,addrs,command.substr(6))) {
+            if (dbg.interrupt())
+               return;
+            result="error unable to stop the program";
+         }
+      } else {
+         result="error unknown command "+command;
+      }
+      ControlSocket::reply(session.controlClient,result);
+      session.controlCommands.erase(session.controlCommands.begin());
+      session.controlServed=true;
+   }
+   // Done with this client once it closed its side or its commands are complete, else wait for more
+   if (session.controlOpen&&((!session.controlServed)||(!session.controlInput.empty())))
+      return;
+   dbg.unwatch(session.controlClient);
+   ControlSocket::finish(session.controlClient);
+   session.controlClient=-1;
+   dbg.watch(session.control->getFd());
+}
+//---------------------------------------------------------------------------
+static void countHit(Debugger& dbg,Session& session,void* bpLocation,Debugger::BreakpointInfo& i)
+   // Count the hit of an address, the first one goes into the log and the timeline
+{
+   if ((!i.hits)&&session.log)
+      session.log->hit(bpLocation);
+   if ((!i.hits)&&(session.timeline.size()<session.timelineCapacity)) {
+      FirstHit hit;
+      hit.address=bpLocation;
+      hit.time=monotonicTime()-session.startTime;
+      hit.thread=dbg.getThread();
+      session.timeline.push_back(hit);
+   }
+   i.hits++;
+}
+//---------------------------------------------------------------------------
+static void handleTrap(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs,void* marker)
+   // Handle a breakpoint hit. The marker breakpoint is always removed
+{
+   unsigned long long trapStart=monotonicTime();
+   void* bpLocation = dbg.getIPBeforeTrap();
+   // The epoch marker stays armed, its first argument names the next epoch.
+   // A line at its address counts as hit in the epoch it closes
+   if (session.epochMarker.count(bpLocation)) {
+      map<void*,Debugger::BreakpointInfo>::iterator line=addrs.find(bpLocation);
+      if ((line!=addrs.end())&&dbg.getActive())
+         countHit(dbg,session,bpLocation,(*line).second);
+      closeEpoch(dbg,session,addrs,dbg.readString(dbg.getArgument(0),200));
+      dbg.skipHitBreakPoint(session.epochMarker[bpLocation]);
+   } else
+   // A unknown trap? Could be a hard-coded one, ignore it
+   if (addrs.count(bpLocation)) {
+      Debugger::BreakpointInfo& i=addrs[bpLocation];
+      if (dbg.getActive()||(bpLocation==marker)) {
+         // Remove the breakpoint
+         dbg.eliminateHitBreakpoint(i);
+         if (dbg.getActive())
+            countHit(dbg,session,bpLocation,i);
+      }
+      else {
+         // Skip the breakpoint
+         dbg.skipHitBreakPoint(i);
+      }
+   }
+   session.stats.trap(monotonicTime()-trapStart);
+}
+//---------------------------------------------------------------------------
+static void handleInput(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs)
+   // Handle a readable control socket or log timer
+{
+   // A control client, served alone. Its input is collected as it arrives, the program keeps running meanwhile
+   if (session.control&&(dbg.getInput()==session.control->getFd())) {
+      int client=session.control->acceptClient();
+      if ((client>=0)&&dbg.watch(client)) {
+         dbg.unwatch(session.control->getFd());
+         session.controlClient=client;
+         session.controlCommands.clear();
+         session.controlInput.clear();
+         session.controlOpen=true;
+         session.controlServed=false;
+      } else if (client>=0) {
+         ControlSocket::finish(client);
+      }
+   } else if ((session.controlClient>=0)&&(dbg.getInput()==session.controlClient)) {
+      // Commands still pending wait for an interrupt, they continue from there
+      bool busy=!session.controlCommands.empty();
+      session.controlOpen=ControlSocket::readCommands(session.controlClient,session.controlInput,session.controlCommands);
+      if (!session.controlOpen)
+         dbg.unwatch(session.controlClient);
+      if (!busy)
+         processControl(dbg,session,addrs);
+   } else if (session.log&&(dbg.getInput()==session.log->getTimer())) {
+      session.log->tick();
+   }
+}
+//---------------------------------------------------------------------------
+static bool runDebugger(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs,void* marker=0)
+   // run to the next breakpoint. The marker breakpoint is always removed
 {
    bool stop=false;
 
@@ -240,38 +1141,159 @@ static bool runDebugger(Debugger& dbg,map<void*,Debugger::BreakpointInfo>& addrs
    switch (e) {
       case Debugger::Error: cerr << "error encountered while tracing" << endl; stop=true; break;
       case Debugger::Exit: cerr << "program terminated" << endl; stop=true; break;
-      case Debugger::Trap: {
-         void* bpLocation = dbg.getIPBeforeTrap();
-         // A unknown trap? Could be a hard-coded one, ignore it
-         if (addrs.count(bpLocation)) {
-            Debugger::BreakpointInfo& i=addrs[bpLocation];
-            if (dbg.getActive()) {
-               // Remove the breakpoint
-               dbg.eliminateHitBreakpoint(i);
-               i.hits++;
-            }
-            else {
-               // Skip the breakpoint
-               dbg.skipHitBreakPoint(i);
-            }
+      case Debugger::Trap: handleTrap(dbg,session,addrs,marker); break;
+      case Debugger::Input: handleInput(dbg,session,addrs); break;
+      case Debugger::Interrupt: processControl(dbg,session,addrs); break;
+   }
+   return stop;
+}
+//---------------------------------------------------------------------------
+static bool runJobs(Debugger& dbg,Session& session,map<void*,Debugger::BreakpointInfo>& addrs,const vector<vector<string> >& jobs,unsigned parallel,unsigned& failed)
+   // Run the jobs, up to parallel at a time. The loaded program is the first one,
+   // the others get copies of its breakpoints. Hits of all jobs are merged, failed counts the failing jobs
+{
+   failed=0;
+   if (!dbg.makeTemplate(addrs)) {
+      cerr << "unable to prepare the breakpoints for the jobs" << endl;
+      return false;
+   }
+   map<long,unsigned> running;
+   running[dbg.getThread()]=0;
+   unsigned next=1;
+   while (!running.empty()) {
+      for (;(next<jobs.size())&&(running.size()<parallel);next++) {
+         long pid=dbg.launch(session.command,jobs[next]);
+         if (!pid) {
+            cerr << "unable to start job " << (next+1) << endl;
+            failed++;
+            continue;
          }
+         running[pid]=next;
+      }
+      switch (dbg.run()) {
+         case Debugger::Error: cerr << "error encountered while tracing" << endl; return false;
+         case Debugger::Exit: {
+            int status=dbg.getExitStatus();
+            map<long,unsigned>::iterator job=running.find(dbg.getThread());
+            if (job==running.end()) break;
+            if ((!WIFEXITED(status))||WEXITSTATUS(status)) {
+               cerr << "job " << ((*job).second+1) << " failed" << endl;
+               failed++;
+            }
+            running.erase(job);
+         } break;
+         case Debugger::Trap: handleTrap(dbg,session,addrs,0); break;
+         case Debugger::Input: handleInput(dbg,session,addrs); break;
+         case Debugger::Interrupt: break;
       }
-      break;
    }
-   return stop;
+   cout << "ran " << jobs.size() << " jobs, " << failed << " failed" << endl;
+   return true;
+}
+//---------------------------------------------------------------------------
+static void showStats(const Stats& stats,unsigned long breakpoints)
+   // Print the timers and counters of bcov itself
+{
+   char buffer[80];
+   cerr << "bcov statistics:" << endl;
+   for (vector<pair<string,unsigned long long> >::const_iterator iter=stats.phases.begin(),limit=stats.phases.end();iter!=limit;++iter) {
+      snprintf(buffer,sizeof(buffer),"  %-16s%10.3f s",(*iter).first.c_str(),(*iter).second/1000000000.0);
+      cerr << buffer << endl;
+   }
+   snprintf(buffer,sizeof(buffer),"  %-16s%10.3f s for %lu traps of %lu breakpoints","trap handling",stats.trapTime/1000000000.0,stats.traps,breakpoints);
+   cerr << buffer << endl;
+   cerr << "  trap latency:" << endl;
+   for (unsigned index=0;index<Stats::latencyBuckets;index++) {
+      if (!stats.trapLatency[index]) continue;
+      snprintf(buffer,sizeof(buffer),"    <%8lu us %12lu",1ul<<index,stats.trapLatency[index]);
+      cerr << buffer << endl;
+   }
+   const Debugger::Counters& counters=Debugger::getCounters();
+   cerr << "  ptrace: " << counters.peeks << " peek, " << counters.pokes << " poke, " << counters.registers << " registers, " << counters.resumes << " resume, " << counters.otherPtrace << " other" << endl
+        << "  waitpid: " << counters.waits << ", poll: " << counters.polls << ", injected: " << counters.injected << endl;
+}
+//---------------------------------------------------------------------------
+static bool writeStatsJson(const string& fileName,const Stats& stats,unsigned long breakpoints)
+   // Write the timers and counters of bcov itself as JSON
+{
+   ofstream out(fileName.c_str());
+   if (!out.is_open()) {
+      cerr << "unable to write " << fileName << endl;
+      return false;
+   }
+   out << "{" << endl << "  \"phases_ns\": {";
+   for (vector<pair<string,unsigned long long> >::const_iterator iter=stats.phases.begin(),limit=stats.phases.end();iter!=limit;++iter)
+      out << ((iter==stats.phases.begin())?"":",") << endl << "    \"" << (*iter).first << "\": " << (*iter).second;
+   out << endl << "  }," << endl
+       << "  \"breakpoints\": " << breakpoints << "," << endl
+       << "  \"traps\": " << stats.traps << "," << endl
+       << "  \"trap_ns\": " << stats.trapTime << "," << endl
+       << "  \"trap_latency_us\": [";
+   for (unsigned index=0;index<Stats::latencyBuckets;index++)
+      out << (index?", ":"") << "{\"below\": " << (1ul<<index) << ", \"count\": " << stats.trapLatency[index] << "}";
+   const Debugger::Counters& counters=Debugger::getCounters();
+   out << "]," << endl
+       << "  \"syscalls\": {\"ptrace_peek\": " << counters.peeks << ", \"ptrace_poke\": " << counters.pokes
+       << ", \"ptrace_registers\": " << counters.registers << ", \"ptrace_resume\": " << counters.resumes
+       << ", \"ptrace_other\": " << counters.otherPtrace << ", \"waitpid\": " << counters.waits
+       << ", \"poll\": " << counters.polls << ", \"injected\": " << counters.injected << "}" << endl
+       << "}" << endl;
+   return true;
+}
+//---------------------------------------------------------------------------
+static bool parseNumber(const char* option,const char* text,unsigned& value)
+   // Parse the number argument of an option, the whole text must be a number
+{
+   char* end;
+   unsigned long result=strtoul(text,&end,10);
+   if ((end==text)||(*end)||(!isdigit(static_cast<unsigned char>(*text)))||(result>~0u)) {
+      cerr << "invalid " << option << " value " << text << ", expected a number" << endl;
+      return false;
+   }
+   value=result;
+   return true;
 }
 //---------------------------------------------------------------------------
 static void showHelp(const char* argv0)
    // Show the help
 {
-   cout << "usage: " << argv0 << " [-o dump] [-l library] command [arg(s)]" << endl
+   cout << "usage: " << argv0 << " [--compact log [-o dump] [--text]]" << endl
+        << "       " << argv0 << " [--compact-dump dump [--text]]" << endl
+        << "       " << argv0 << " [-o dump] [--text] [--append] [--baseline dump] [--sample fraction [--seed n]] [--log file] [--epoch-marker function] [--timeline n] [--stats] [--stats-json file] [-l library] [-i pattern] [-x pattern] [-c socket] [-F inputs [-m function] [-p]] [-J jobs [-j n]] command [arg(s)]" << endl
       << endl
       << "\t--help\t\tshow help and end" << endl
       << "\t--version\tshow the tool version and end" << endl
+      << "\t--text\t\twrite the dump in the text format instead of the binary one" << endl
+      << "\t--baseline\tonly instrument lines not covered in the given dump, and" << endl
+      << "\t\t\tmerge it into the result" << endl
+      << "\t--sample\tonly instrument the given fraction of the addresses" << endl
+      << "\t--seed\t\tseed for choosing the sampled addresses (default 0)" << endl
+      << "\t--log\t\tappend newly hit addresses to the given delta log" << endl
+      << "\t--log-every\tflush the delta log after that many hits (default 1000)" << endl
+      << "\t--log-interval\tflush the delta log every that many ms (default 1000)" << endl
+      << "\t--compact\tconvert the given delta log into a dump and end" << endl
+      << "\t--append\tappend the result to the dump as a new segment, under a file lock" << endl
+      << "\t--compact-dump\tmerge the segments of the given dump in place and end" << endl
+      << "\t--epoch-marker\tfunction that closes the current epoch when called. Its" << endl
+      << "\t\t\tfirst argument, a string, names the next epoch" << endl
+      << "\t--timeline\trecord time and thread of up to n first hits" << endl
+      << "\t--stats\t\tprint timers and counters of bcov itself at the end" << endl
+      << "\t--stats-json\twrite them as JSON to the given file" << endl
       << endl
       << "\t-o\t\tcoverage output file" << endl
       << "\t-l\t\textra library to cover as well" << endl
-      << "\t-s\t\tcatch SIGUSR1 and SIGUSR2 to enable disable logging" << endl;
+      << "\t-i\t\tonly instrument source files matching the prefix or glob" << endl
+      << "\t-x\t\tdo not instrument source files matching the prefix or glob" << endl
+      << "\t-s\t\tcatch SIGUSR1 and SIGUSR2 to enable disable logging" << endl
+      << "\t-c\t\tcontrol socket accepting start, stop, snapshot <file>, reset and" << endl
+      << "\t\t\tepoch <name>" << endl
+      << "\t-F\t\tfork server mode, run once for each input file listed in the given file." << endl
+      << "\t\t\tThe input is passed on stdin and replaces @@ arguments" << endl
+      << "\t-m\t\tfunction to start the fork server at (default main)" << endl
+      << "\t-p\t\twrite a dump per input as <dump>.<n> in fork server mode" << endl
+      << "\t-J\t\trun the command once for each line of the given job file, which" << endl
+      << "\t\t\tlists the arguments of each run" << endl
+      << "\t-j\t\trun that many jobs concurrently (default the number of cpus)" << endl;
 }
 //---------------------------------------------------------------------------
 static void showVersion(const char* argv0)
@@ -285,8 +1307,19 @@ int main(int argc,char* argv[])
    // Parse the command line
    int start=1;
    vector<string> libraries;
+   PathFilter filter;
    string outputfile=".bcovdump";
    bool active=true;
+   string inputList,markerName="main",controlPath;
+   bool perRunDumps=false;
+   string jobFile;
+   unsigned parallelJobs=onlineCpus(),failedJobs=0;
+   Session session;
+   double sampleFraction=1;
+   unsigned sampleSeed=0;
+   string logFile,compactFile,epochMarkerName,statsJsonFile,compactDumpFile;
+   bool showStatistics=false,append=false;
+   unsigned logEvery=1000,logInterval=1000;
 
    cout << "process commandline..." << endl;
    while (start<argc) {
@@ -297,6 +1330,66 @@ int main(int argc,char* argv[])
          } else if (strcmp(argv[start],"--version")==0) {
             showVersion(argv[0]);
             return 1;
+         } else if (strcmp(argv[start],"--baseline")==0) {
+            if ((++start>=argc)||(!BaselineReader(session.baseline).read(argv[start])))
+               return 1;
+            start++;
+         } else if ((strcmp(argv[start],"--sample")==0)&&(start+1<argc)) {
+            char* end;
+            sampleFraction=strtod(argv[++start],&end);
+            if ((end==argv[start])||(*end)||(!(sampleFraction>0))||(sampleFraction>1)) {
+               cerr << "invalid sample fraction " << argv[start] << ", expected a number in (0,1]" << endl;
+               return 1;
+            }
+            start++;
+         } else if ((strcmp(argv[start],"--seed")==0)&&(start+1<argc)) {
+            char* end;
+            sampleSeed=strtoul(argv[++start],&end,10);
+            if ((end==argv[start])||(*end)) {
+               cerr << "invalid seed " << argv[start] << ", expected a number" << endl;
+               return 1;
+            }
+            start++;
+         } else if ((strcmp(argv[start],"--log")==0)&&(start+1<argc)) {
+            logFile=argv[++start];
+            start++;
+         } else if ((strcmp(argv[start],"--log-every")==0)&&(start+1<argc)) {
+            if (!parseNumber(argv[start],argv[start+1],logEvery))
+               return 1;
+            start+=2;
+         } else if ((strcmp(argv[start],"--log-interval")==0)&&(start+1<argc)) {
+            if (!parseNumber(argv[start],argv[start+1],logInterval))
+               return 1;
+            start+=2;
+         } else if (strcmp(argv[start],"--text")==0) {
+            session.format=DumpWriter::Text;
+            start++;
+         } else if (strcmp(argv[start],"--stats")==0) {
+            showStatistics=true;
+            start++;
+         } else if ((strcmp(argv[start],"--stats-json")==0)&&(start+1<argc)) {
+            statsJsonFile=argv[++start];
+            start++;
+         } else if ((strcmp(argv[start],"--timeline")==0)&&(start+1<argc)) {
+            if (!parseNumber(argv[start],argv[start+1],session.timelineCapacity))
+               return 1;
+            if (!session.timelineCapacity) {
+               cerr << "invalid --timeline value 0, expected the number of first hits to record" << endl;
+               return 1;
+            }
+            start+=2;
+         } else if ((strcmp(argv[start],"--epoch-marker")==0)&&(start+1<argc)) {
+            epochMarkerName=argv[++start];
+            start++;
+         } else if (strcmp(argv[start],"--append")==0) {
+            append=true;
+            start++;
+         } else if ((strcmp(argv[start],"--compact-dump")==0)&&(start+1<argc)) {
+            compactDumpFile=argv[++start];
+            start++;
+         } else if ((strcmp(argv[start],"--compact")==0)&&(start+1<argc)) {
+            compactFile=argv[++start];
+            start++;
          } else if (argv[start][1]=='o') {
             if (argv[start][2])
                outputfile=argv[start]+2;
@@ -311,65 +1404,193 @@ int main(int argc,char* argv[])
                path=argv[++start];
             libraries.push_back(realpath(path,0l));
             start++;
+         } else if ((argv[start][1]=='i')||(argv[start][1]=='x')) {
+            char mode=argv[start][1];
+            char *pattern;
+            if (argv[start][2])
+               pattern=(argv[start]+2);
+            else
+               pattern=argv[++start];
+            if (mode=='i')
+               filter.include(rulePattern(pattern)); else
+               filter.exclude(rulePattern(pattern));
+            start++;
          } else if (argv[start][1]=='s') {
             active=false;
             start++;
+         } else if (((argv[start][1]=='F')||(argv[start][1]=='m')||(argv[start][1]=='c'))&&(argv[start][2]||(start+1<argc))) {
+            string& value=(argv[start][1]=='F')?inputList:(argv[start][1]=='m')?markerName:controlPath;
+            value=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if (argv[start][1]=='p') {
+            perRunDumps=true;
+            start++;
+         } else if (((argv[start][1]=='J')||(argv[start][1]=='j'))&&(argv[start][2]||(start+1<argc))) {
+            char mode=argv[start][1];
+            const char* value=argv[start][2]?(argv[start]+2):argv[++start];
+            if (mode=='J') {
+               jobFile=value;
+            } else if (!parseNumber("-j",value,parallelJobs)) {
+               return 1;
+            }
+            start++;
+         } else if (argv[start][1]&&strchr("FmcJj",argv[start][1])&&(!argv[start][2])) {
+            // The argument is missing
+            showHelp(argv[0]);
+            return 1;
          } else break;
       } else break;
    }
+   if (compactFile!="") {
+      if (!compactLog(compactFile,outputfile,session))
+         return 1;
+      cerr << "coverage info written to " << outputfile << endl;
+      return 0;
+   }
+   if (compactDumpFile!="")
+      return compactDump(compactDumpFile)?0:1;
    if (start>=argc) {
       showHelp(argv[0]);
       return 1;
    }
    time_t now=time(0);
-   string timestamp=ctime(&now);
-   string command=argv[start];
-   vector<string> args;
+   session.timestamp=ctime(&now);
+   string command=session.command=argv[start];
+   vector<string>& args=session.args;
    for (int index=start+1;index<argc;index++)
       args.push_back(argv[index]);
+   if (sampleFraction<1) {
+      char buffer[60];
+      snprintf(buffer,sizeof(buffer),"%g %u",sampleFraction,sampleSeed);
+      session.sample=buffer;
+   }
+
+   // Prepare the fork server inputs. They are staged in a file that becomes
+   // the stdin of the program
+   vector<string> inputs,runArgs=args;
+   int inputFd=-1;
+   if (inputList!="") {
+      if (!readInputList(inputList,inputs))
+         return 1;
+      char inputPath[]="/tmp/bcov-input.XXXXXX";
+      if (((inputFd=mkstemp(inputPath))<0)||(dup2(inputFd,0)<0)) {
+         cerr << "unable to create the input file" << endl;
+         return 1;
+      }
+      unlink(inputPath);
+      for (vector<string>::iterator iter=runArgs.begin(),limit=runArgs.end();iter!=limit;++iter)
+         if ((*iter)=="@@") {
+            char fdPath[40];
+            snprintf(fdPath,sizeof(fdPath),"/proc/self/fd/%d",inputFd);
+            (*iter)=fdPath;
+         }
+   }
+
+   // Read the jobs. The first one is run by the loaded program
+   vector<vector<string> > jobs;
+   if (jobFile!="") {
+      if ((inputList!="")||(controlPath!="")||libraries.size()||(epochMarkerName!="")) {
+         cerr << "-J cannot be combined with -F, -c, -l or --epoch-marker" << endl;
+         return 1;
+      }
+      if (!readJobs(jobFile,jobs))
+         return 1;
+      if (jobs.empty()) {
+         cerr << "no jobs in " << jobFile << endl;
+         return 1;
+      }
+      if (!parallelJobs)
+         parallelJobs=1;
+      runArgs=jobs.front();
+   }
 
    // Open the debugger
+   Stats& stats=session.stats;
+   unsigned long long phaseStart=monotonicTime();
    Debugger dbg;
-   if (!dbg.load(command,args)) {
+   if (!dbg.load(command,runArgs)) {
       cerr << "unable to load " << command << endl;
       return 1;
    }
+   session.timeline.reserve(session.timelineCapacity);
+   session.startTime=monotonicTime();
    
    dbg.setActive(active);
+   dbg.setSignalControl(!active);
+
+   // Open the control socket
+   ControlSocket control;
+   if (controlPath!="") {
+      if ((!control.open(controlPath))||(!dbg.watch(control.getFd())))
+         return 1;
+      session.control=&control;
+   }
+
+   // Open the delta log
+   DeltaLog log;
+   if (logFile!="") {
+      if ((!log.open(logFile,logEvery,logInterval))||(!logHeader(log,session)))
+         return 1;
+      if (log.getTimer()>=0)
+         dbg.watch(log.getTimer());
+      session.log=&log;
+   }
 
    // Find active lines
+   phaseStart=stats.phase("load",phaseStart);
    cout << "probing debug information for " << command << " ..." << endl;
-   map<string,vector<pair<unsigned,void*> > > activeLines;
-   if (!readDwarfLineNumbers(command,activeLines,0)) {
+   map<string,vector<pair<unsigned,void*> > >& activeLines=session.activeLines;
+   if (!readDwarfLineNumbers(command,activeLines,0,filter)) {
       cerr << "unable to read dwarf2 debug info for "<< command << endl;
       return 1;
    }
    cout << "found active lines in " << activeLines.size() << " source files" << endl;
+   phaseStart=stats.phase("dwarf",phaseStart);
 
    // Set breakpoints
    map<void*,Debugger::BreakpointInfo> activeAddresses;
-   for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=activeLines.begin(),limit=activeLines.end();iter!=limit;++iter) {
-      // Collect all addresses
-      for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
-         activeAddresses[(*iter2).second];
-   }
+   collectAddresses(activeLines,session.baseline,sampleFraction,sampleSeed,activeAddresses);
    // Set the breakpoints
    if (!dbg.setBreakpoints(activeAddresses)) {
       cerr << "unable to set breakpoints" << endl;
       return false;
    }
    cout << "set " << activeAddresses.size() << " breakpoints" << endl;
+   buildIndex(session);
+   if (session.log)
+      logLines(log,activeLines,activeAddresses);
+
+   // Set the epoch marker. It takes over a line breakpoint at the same address, the line stays in the coverage
+   if (epochMarkerName!="") {
+      void* epochMarker=findFunction(command,epochMarkerName);
+      if (!epochMarker) {
+         cerr << "unable to find " << epochMarkerName << " in " << command << endl;
+         return 1;
+      }
+      if (activeAddresses.count(epochMarker)) {
+         session.epochMarker[epochMarker]=activeAddresses[epochMarker];
+      } else {
+         session.epochMarker[epochMarker];
+         if (!dbg.setBreakpoints(session.epochMarker)) {
+            cerr << "unable to set breakpoints" << endl;
+            return 1;
+         }
+      }
+   }
+
+   phaseStart=stats.phase("breakpoints",phaseStart);
 
    bool stop=false;
    if (libraries.size()) {
-     if (!(stop = runDebugger(dbg,activeAddresses))) {
+     if (!(stop = runDebugger(dbg,session,activeAddresses))) {
+        phaseStart=stats.phase("run",phaseStart);
         dbg.loadBaseAddresses();
         map<string,vector<pair<unsigned,void*> > > activeLibraryLines;
         int last_size=0;
         for (int index=0;index<libraries.size();index++) {
           unsigned long base=dbg.getBaseAddress(libraries[index]);
           cout << "probing debug information for " << libraries[index] << " loaded at " << base << " ..." << endl;
-          if (!readDwarfLineNumbers(libraries[index],activeLibraryLines,base)) {
+          if (!readDwarfLineNumbers(libraries[index],activeLibraryLines,base,filter)) {
              cerr << "unable to read dwarf2 debug info for " << libraries[index] << endl;
              return 1;
           }
@@ -377,28 +1598,84 @@ int main(int argc,char* argv[])
           last_size=activeLibraryLines.size();
         }
         activeLines.insert(activeLibraryLines.begin(),activeLibraryLines.end());
+        phaseStart=stats.phase("dwarf",phaseStart);
 
         // Set more breakpoints
         map<void*,Debugger::BreakpointInfo> activeLibraryAddresses;
-        for (map<string,vector<pair<unsigned,void*> > >::const_iterator iter=activeLibraryLines.begin(),limit=activeLibraryLines.end();iter!=limit;++iter) {
-           //cout << "file " << (*iter).first << endl;
-           // Collect all addresses
-           for (vector<pair<unsigned,void*> >::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
-              activeLibraryAddresses[(*iter2).second];
-        }
+        collectAddresses(activeLibraryLines,session.baseline,sampleFraction,sampleSeed,activeLibraryAddresses);
         // Set the breakpoints
         if (!dbg.setBreakpoints(activeLibraryAddresses)) {
            cerr << "unable to set breakpoints" << endl;
            return false;
         }
         cout << "set " << activeLibraryAddresses.size() << " more breakpoints" << endl;
+        buildIndex(session);
+        if (session.log)
+           logLines(log,activeLibraryLines,activeLibraryAddresses);
         activeAddresses.insert(activeLibraryAddresses.begin(),activeLibraryAddresses.end());
+        phaseStart=stats.phase("breakpoints",phaseStart);
      }
    }
 
+   // Run the jobs. They share the debug information and the breakpoints
+   if (jobs.size()) {
+      cout << "running " << jobs.size() << " jobs, " << parallelJobs << " at a time" << endl;
+      if (!runJobs(dbg,session,activeAddresses,jobs,parallelJobs,failedJobs))
+         return 1;
+      stop=true;
+   }
+
+   // Run the fork server. Everything up to the marker is shared by all inputs
+   if (inputs.size()) {
+      void* marker=findFunction(command,markerName);
+      if (!marker) {
+         cerr << "unable to find " << markerName << " in " << command << endl;
+         return 1;
+      }
+      if (!activeAddresses.count(marker)) {
+         map<void*,Debugger::BreakpointInfo> markerAddress;
+         markerAddress[marker];
+         dbg.setBreakpoints(markerAddress);
+         activeAddresses.insert(markerAddress.begin(),markerAddress.end());
+      }
+      while ((!stop)&&(dbg.getIP()!=marker))
+         stop=runDebugger(dbg,session,activeAddresses,marker);
+      if (stop||(!dbg.startForkServer())) {
+         cerr << "program terminated before reaching " << markerName << endl;
+         return 1;
+      }
+      cout << "fork server started at " << markerName << ", running " << inputs.size() << " inputs" << endl;
+
+      const map<void*,Debugger::BreakpointInfo> serverAddresses=activeAddresses;
+      for (unsigned index=0;index<inputs.size();index++) {
+         if (!stageInput(inputFd,inputs[index])) {
+            cerr << "unable to read input " << inputs[index] << endl;
+            continue;
+         }
+         if (!dbg.spawn()) {
+            cerr << "unable to fork the program for " << inputs[index] << endl;
+            return 1;
+         }
+         map<void*,Debugger::BreakpointInfo> runAddresses=serverAddresses;
+         for (stop=false;!stop;)
+            stop=runDebugger(dbg,session,runAddresses);
+         if (perRunDumps) {
+            char suffix[20];
+            snprintf(suffix,sizeof(suffix),".%u",index);
+            dumpResult(outputfile+suffix,session,runAddresses,false);
+         }
+         // Merge the hits of this run. A reset might have cleared shared hits
+         map<void*,Debugger::BreakpointInfo>::const_iterator iter2=serverAddresses.begin(),iter3=runAddresses.begin();
+         for (map<void*,Debugger::BreakpointInfo>::iterator iter=activeAddresses.begin(),limit=activeAddresses.end();iter!=limit;++iter,++iter2,++iter3)
+            if ((*iter3).second.hits>(*iter2).second.hits)
+               (*iter).second.hits+=(*iter3).second.hits-(*iter2).second.hits;
+      }
+      stop=true;
+   }
+
    // And execute
    while (!stop) {
-      stop = runDebugger(dbg,activeAddresses);
+      stop = runDebugger(dbg,session,activeAddresses);
    }
 
    // Close the debugger
@@ -406,11 +1683,31 @@ int main(int argc,char* argv[])
       cerr << "unable to close the debugger" << endl;
       return 1;
    }
+   phaseStart=stats.phase("run",phaseStart);
 
    // Dump it
-   dumpResult(outputfile,command,args,timestamp,activeLines,activeAddresses);
+   if (session.controlClient>=0) {
+      ControlSocket::reply(session.controlClient,"error program terminated");
+      ControlSocket::finish(session.controlClient);
+   }
+   log.close();
+   // Close the last epoch, the totals cover all of them
+   if ((!session.epochMarker.empty())||(!session.epochs.empty())) {
+      recordEpoch(session,activeAddresses);
+      for (vector<pair<string,vector<void*> > >::const_iterator iter=session.epochs.begin(),limit=session.epochs.end();iter!=limit;++iter)
+         for (vector<void*>::const_iterator iter2=(*iter).second.begin(),limit2=(*iter).second.end();iter2!=limit2;++iter2)
+            activeAddresses[*iter2].hits++;
+   }
+   dumpResult(outputfile,session,activeAddresses,true,append);
    cerr << "coverage info written to " << outputfile << endl;
+   stats.phase("dump",phaseStart);
+
+   if (showStatistics)
+      showStats(stats,activeAddresses.size());
+   if ((statsJsonFile!="")&&(!writeStatsJson(statsJsonFile,stats,activeAddresses.size())))
+      return 1;
 
-   return 0;
+   // The dump holds the hits of all jobs, but failing jobs fail the run
+   return failedJobs?1:0;
 }
 //---------------------------------------------------------------------------
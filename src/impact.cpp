@@ -0,0 +1,553 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "Dump.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+// Maps source lines to the tests that hit them. A test is a dump, or with
+// --epochs an epoch of a dump. The index file starts with "BCOVTIDX", a
+// version, the test and file counts and the offsets of five sections:
+// the tests (string offset and length), the files sorted by name
+// (string offset and length, line count, first line), the lines sorted
+// per file (line number, offset of its test set), the test sets and the
+// strings. All integers are little endian. A test set is a list of
+// containers for 65536 test ids each, either a sorted array of the low
+// 16 bits or a bitmap, identical sets are stored once.
+//---------------------------------------------------------------------------
+/// The magic number of an index
+static const char indexMagic[8]={'B','C','O','V','T','I','D','X'};
+/// The format version
+static const unsigned indexVersion=1;
+/// The size of the header
+static const unsigned headerSize=8+4*4+5*8;
+/// The sizes of the table entries
+static const unsigned testEntrySize=12,fileEntrySize=24,lineEntrySize=12;
+/// A bitset word
+typedef unsigned long long Word;
+/// Containers with more ids become bitmaps
+static const unsigned arrayLimit=4096;
+/// Words of a bitmap container
+static const unsigned bitmapWords=65536/64;
+//---------------------------------------------------------------------------
+/// A set of test ids, split into containers of 65536 ids
+class TestSet
+{
+   private:
+   /// The ids sharing their upper bits
+   struct Container {
+      /// The upper bits
+      unsigned key;
+      /// The sorted lower bits, while the container is small
+      vector<unsigned short> values;
+      /// The bitmap, once it is large
+      vector<Word> bits;
+   };
+   /// The containers, sorted by key
+   vector<Container> containers;
+
+   public:
+   /// Is the set empty?
+   bool empty() const { return containers.empty(); }
+   /// Add a test
+   void add(unsigned id);
+   /// Append the serialized set
+   void write(string& out) const;
+};
+//---------------------------------------------------------------------------
+/// Order containers by key
+struct ContainerOrder { template <class T> bool operator()(const T& a,unsigned key) const { return a.key<key; } };
+//---------------------------------------------------------------------------
+void TestSet::add(unsigned id)
+   // Add a test. Tests usually come in increasing order, which appends
+{
+   unsigned key=id>>16;
+   unsigned short low=id&0xFFFF;
+   vector<Container>::iterator c=containers.end();
+   if (containers.empty()||(containers.back().key!=key)) {
+      c=lower_bound(containers.begin(),containers.end(),key,ContainerOrder());
+      if ((c==containers.end())||((*c).key!=key)) {
+         c=containers.insert(c,Container());
+         (*c).key=key;
+      }
+   } else --c;
+   Container& container=*c;
+
+   if (!container.bits.empty()) {
+      container.bits[low/64]|=1ull<<(low%64);
+      return;
+   }
+   vector<unsigned short>& values=container.values;
+   if (values.empty()||(values.back()<low)) {
+      values.push_back(low);
+   } else {
+      vector<unsigned short>::iterator pos=lower_bound(values.begin(),values.end(),low);
+      if ((*pos)==low)
+         return;
+      values.insert(pos,low);
+   }
+   if (values.size()>arrayLimit) {
+      container.bits.assign(bitmapWords,0);
+      for (vector<unsigned short>::const_iterator iter=values.begin(),limit=values.end();iter!=limit;++iter)
+         container.bits[(*iter)/64]|=1ull<<((*iter)%64);
+      vector<unsigned short>().swap(values);
+   }
+}
+//---------------------------------------------------------------------------
+void TestSet::write(string& out) const
+   // Append the serialized set: the container count, then key, kind and count of each container followed by its content
+{
+   appendLittleEndian(out,containers.size(),4);
+   for (vector<Container>::const_iterator iter=containers.begin(),limit=containers.end();iter!=limit;++iter) {
+      const Container& c=*iter;
+      appendLittleEndian(out,c.key,2);
+      if (c.bits.empty()) {
+         appendLittleEndian(out,0,2);
+         appendLittleEndian(out,c.values.size(),4);
+         for (vector<unsigned short>::const_iterator iter2=c.values.begin(),limit2=c.values.end();iter2!=limit2;++iter2)
+            appendLittleEndian(out,*iter2,2);
+      } else {
+         unsigned count=0;
+         for (unsigned index=0;index<bitmapWords;index++)
+            count+=__builtin_popcountll(c.bits[index]);
+         appendLittleEndian(out,1,2);
+         appendLittleEndian(out,count,4);
+         for (unsigned index=0;index<bitmapWords;index++)
+            appendLittleEndian(out,c.bits[index],8);
+      }
+   }
+}
+//---------------------------------------------------------------------------
+/// Builds the index from dumps
+class IndexBuilder : public DumpReader
+{
+   private:
+   /// Tests are epochs?
+   bool perEpoch;
+   /// The test ids by name
+   map<string,unsigned> testIds;
+   /// The test names
+   vector<string> tests;
+   /// The test sets of the lines of each file, indexed by line number
+   map<string,vector<TestSet> > files;
+   /// The current dump
+   string dumpName;
+   /// The current test
+   unsigned currentTest;
+   /// Reading the totals?
+   bool inTotals;
+   /// The current file
+   vector<TestSet>* currentFile;
+
+   /// The id of a test
+   unsigned testId(const string& name);
+
+   protected:
+   /// The start of a segment, beginning with the totals
+   void segment() { inTotals=true; if (!perEpoch) currentTest=testId(dumpName); }
+   /// The start of an epoch section
+   bool epoch(const string& name) { inTotals=false; if (perEpoch) currentTest=testId(name); return perEpoch; }
+   /// A new source file
+   bool file(const string& name) { if (perEpoch&&inTotals) return false; currentFile=&files[name]; return true; }
+   /// A line of the current file
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots);
+
+   public:
+   /// Constructor
+   explicit IndexBuilder(bool perEpoch) : perEpoch(perEpoch),currentTest(0),inTotals(true),currentFile(0) {}
+
+   /// Add a dump
+   bool add(const string& fileName);
+   /// Write the index
+   bool write(const string& fileName) const;
+   /// The number of tests
+   unsigned testCount() const { return tests.size(); }
+};
+//---------------------------------------------------------------------------
+unsigned IndexBuilder::testId(const string& name)
+   // The id of a test. Tests of the same name are merged
+{
+   map<string,unsigned>::const_iterator iter=testIds.find(name);
+   if (iter!=testIds.end())
+      return (*iter).second;
+   testIds[name]=tests.size();
+   tests.push_back(name);
+   return tests.size()-1;
+}
+//---------------------------------------------------------------------------
+void IndexBuilder::line(unsigned lineNo,unsigned /*hitsPossible*/,unsigned hits,unsigned /*armed*/,const LineSlots& /*slots*/)
+   // A line of the current file. Only hit lines are recorded
+{
+   if (!hits)
+      return;
+   if (lineNo>=currentFile->size())
+      currentFile->resize(lineNo+1);
+   (*currentFile)[lineNo].add(currentTest);
+}
+//---------------------------------------------------------------------------
+bool IndexBuilder::add(const string& fileName)
+   // Add a dump
+{
+   dumpName=fileName;
+   segment();
+   return read(fileName);
+}
+//---------------------------------------------------------------------------
+bool IndexBuilder::write(const string& fileName) const
+   // Write the index
+{
+   string testTable,fileTable,lineTable,sets,strings;
+   for (vector<string>::const_iterator iter=tests.begin(),limit=tests.end();iter!=limit;++iter) {
+      appendLittleEndian(testTable,strings.length(),8);
+      appendLittleEndian(testTable,(*iter).length(),4);
+      strings+=*iter;
+   }
+
+   // The sets, identical ones are stored once
+   map<pair<unsigned long long,unsigned>,vector<unsigned long long> > known;
+   string set;
+   unsigned long long lineCount=0;
+   unsigned fileCount=0;
+   for (map<string,vector<TestSet> >::const_iterator iter=files.begin(),limit=files.end();iter!=limit;++iter) {
+      const vector<TestSet>& lines=(*iter).second;
+      unsigned long long firstLine=lineCount;
+      for (unsigned lineNo=0;lineNo<lines.size();lineNo++) {
+         if (lines[lineNo].empty())
+            continue;
+         set.clear();
+         lines[lineNo].write(set);
+         unsigned long long hash=hashStart;
+         hashBytes(hash,set.data(),set.length());
+         vector<unsigned long long>& candidates=known[pair<unsigned long long,unsigned>(hash,set.length())];
+         unsigned long long offset=sets.length();
+         for (vector<unsigned long long>::const_iterator iter2=candidates.begin(),limit2=candidates.end();iter2!=limit2;++iter2)
+            if (sets.compare(*iter2,set.length(),set)==0) {
+               offset=*iter2;
+               break;
+            }
+         if (offset==sets.length()) {
+            candidates.push_back(offset);
+            sets+=set;
+         }
+         appendLittleEndian(lineTable,lineNo,4);
+         appendLittleEndian(lineTable,offset,8);
+         lineCount++;
+      }
+      if (lineCount==firstLine)
+         continue;
+      appendLittleEndian(fileTable,strings.length(),8);
+      appendLittleEndian(fileTable,(*iter).first.length(),4);
+      appendLittleEndian(fileTable,lineCount-firstLine,4);
+      appendLittleEndian(fileTable,firstLine,8);
+      strings+=(*iter).first;
+      fileCount++;
+   }
+
+   // The header
+   string header(indexMagic,sizeof(indexMagic));
+   appendLittleEndian(header,indexVersion,4);
+   appendLittleEndian(header,tests.size(),4);
+   appendLittleEndian(header,fileCount,4);
+   appendLittleEndian(header,0,4);
+   unsigned long long offset=headerSize;
+   appendLittleEndian(header,offset,8); offset+=testTable.length();
+   appendLittleEndian(header,offset,8); offset+=fileTable.length();
+   appendLittleEndian(header,offset,8); offset+=lineTable.length();
+   appendLittleEndian(header,offset,8); offset+=sets.length();
+   appendLittleEndian(header,offset,8);
+
+   FILE* out=fopen(fileName.c_str(),"wb");
+   if (!out) {
+      cerr << "unable to write " << fileName << endl;
+      return false;
+   }
+   const string* parts[]={&header,&testTable,&fileTable,&lineTable,&sets,&strings};
+   bool ok=true;
+   for (unsigned index=0;index<sizeof(parts)/sizeof(parts[0]);index++)
+      ok&=(fwrite(parts[index]->data(),1,parts[index]->length(),out)==parts[index]->length());
+   ok&=(fclose(out)==0);
+   if (!ok)
+      cerr << "unable to write " << fileName << endl;
+   return ok;
+}
+//---------------------------------------------------------------------------
+/// A mapped index
+class Index
+{
+   private:
+   /// The content
+   const unsigned char* data;
+   /// The size
+   unsigned long size;
+   /// The counts
+   unsigned tests,files;
+   /// The sections
+   unsigned long long testTable,fileTable,lineTable,sets,strings;
+
+   /// A string
+   string getString(unsigned long long offset,unsigned len) const;
+   /// The name of a file
+   string fileName(unsigned file) const { const unsigned char* e=data+fileTable+file*fileEntrySize; return getString(readLittleEndian(e,8),readLittleEndian(e+8,4)); }
+   /// Add the tests of a set
+   bool addSet(unsigned long long offset,vector<Word>& result) const;
+
+   public:
+   /// Constructor
+   Index() : data(0),size(0) {}
+   /// Destructor
+   ~Index();
+
+   /// Map an index
+   bool open(const string& fileName);
+   /// Add the tests hitting lines from-to of a file. Files are matched by name or by a path suffix
+   bool query(const string& file,unsigned from,unsigned to,vector<Word>& result) const;
+   /// The number of tests
+   unsigned testCount() const { return tests; }
+   /// The name of a test
+   string testName(unsigned test) const { const unsigned char* e=data+testTable+test*testEntrySize; return getString(readLittleEndian(e,8),readLittleEndian(e+8,4)); }
+};
+//---------------------------------------------------------------------------
+Index::~Index()
+   // Destructor
+{
+   if (data)
+      munmap(const_cast<unsigned char*>(data),size);
+}
+//---------------------------------------------------------------------------
+bool Index::open(const string& fileName)
+   // Map an index and check its tables
+{
+   int fd=::open(fileName.c_str(),O_RDONLY);
+   struct stat info;
+   if ((fd<0)||(fstat(fd,&info)!=0)) {
+      cerr << "unable to open " << fileName << endl;
+      if (fd>=0) close(fd);
+      return false;
+   }
+   size=info.st_size;
+   void* m=(size>=headerSize)?mmap(0,size,PROT_READ,MAP_PRIVATE,fd,0):MAP_FAILED;
+   close(fd);
+   if (m==MAP_FAILED) {
+      cerr << "invalid index " << fileName << endl;
+      return false;
+   }
+   data=static_cast<const unsigned char*>(m);
+   tests=readLittleEndian(data+12,4);
+   files=readLittleEndian(data+16,4);
+   testTable=readLittleEndian(data+24,8);
+   fileTable=readLittleEndian(data+32,8);
+   lineTable=readLittleEndian(data+40,8);
+   sets=readLittleEndian(data+48,8);
+   strings=readLittleEndian(data+56,8);
+   if ((memcmp(data,indexMagic,sizeof(indexMagic))!=0)||(readLittleEndian(data+8,4)!=indexVersion)||
+       (testTable+static_cast<unsigned long long>(tests)*testEntrySize>fileTable)||(fileTable+static_cast<unsigned long long>(files)*fileEntrySize>lineTable)||
+       (lineTable>sets)||((sets-lineTable)%lineEntrySize)||(sets>strings)||(strings>size)) {
+      cerr << "invalid index " << fileName << endl;
+      return false;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+string Index::getString(unsigned long long offset,unsigned len) const
+   // A string
+{
+   if (strings+offset+len>size)
+      return "?";
+   return string(reinterpret_cast<const char*>(data+strings+offset),len);
+}
+//---------------------------------------------------------------------------
+bool Index::addSet(unsigned long long offset,vector<Word>& result) const
+   // Add the tests of a set
+{
+   const unsigned char* pos=data+sets+offset,*limit=data+strings;
+   if (pos+4>limit)
+      return false;
+   unsigned containers=readLittleEndian(pos,4);
+   pos+=4;
+   for (unsigned index=0;index<containers;index++) {
+      if (pos+8>limit)
+         return false;
+      unsigned base=readLittleEndian(pos,2)<<16,kind=readLittleEndian(pos+2,2),count=readLittleEndian(pos+4,4);
+      pos+=8;
+      if (kind==0) {
+         if (pos+2ull*count>limit)
+            return false;
+         for (unsigned index2=0;index2<count;index2++,pos+=2) {
+            unsigned test=base|readLittleEndian(pos,2);
+            if (test<tests)
+               result[test/64]|=1ull<<(test%64);
+         }
+      } else {
+         if (pos+8*bitmapWords>limit)
+            return false;
+         for (unsigned index2=0;index2<bitmapWords;index2++,pos+=8)
+            if (base/64+index2<result.size())
+               result[base/64+index2]|=readLittleEndian(pos,8);
+      }
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool Index::query(const string& file,unsigned from,unsigned to,vector<Word>& result) const
+   // Add the tests hitting lines from-to of a file
+{
+   // The file by name, else all files ending with it
+   vector<unsigned> matches;
+   unsigned lower=0,upper=files;
+   while (lower<upper) {
+      unsigned middle=(lower+upper)/2;
+      if (fileName(middle)<file) lower=middle+1; else upper=middle;
+   }
+   if ((lower<files)&&(fileName(lower)==file)) {
+      matches.push_back(lower);
+   } else {
+      string suffix=(file[0]=='/')?file:("/"+file);
+      for (unsigned index=0;index<files;index++) {
+         string name=fileName(index);
+         if ((name.length()>=suffix.length())&&(name.compare(name.length()-suffix.length(),suffix.length(),suffix)==0))
+            matches.push_back(index);
+      }
+   }
+
+   // The lines in the range
+   for (vector<unsigned>::const_iterator iter=matches.begin(),limit=matches.end();iter!=limit;++iter) {
+      const unsigned char* entry=data+fileTable+(*iter)*fileEntrySize;
+      unsigned long long lineCount=readLittleEndian(entry+12,4),firstLine=readLittleEndian(entry+16,8);
+      if (lineTable+(firstLine+lineCount)*lineEntrySize>sets)
+         return false;
+      const unsigned char* lines=data+lineTable+firstLine*lineEntrySize;
+      unsigned long long lower=0,upper=lineCount;
+      while (lower<upper) {
+         unsigned long long middle=(lower+upper)/2;
+         if (readLittleEndian(lines+middle*lineEntrySize,4)<from) lower=middle+1; else upper=middle;
+      }
+      for (;(lower<lineCount)&&(readLittleEndian(lines+lower*lineEntrySize,4)<=to);lower++)
+         if (!addSet(readLittleEndian(lines+lower*lineEntrySize+4,8),result))
+            return false;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+static void showHelp(const char* argv0)
+   // Show the help
+{
+   cout << "usage: " << argv0 << " -o index [--epochs] [-l list] [dumpfile(s)]" << endl
+      << "       " << argv0 << " -q index file[:line[-line]]..." << endl
+      << endl
+      << "\t--help\t\tshow help and end" << endl
+      << "\t--version\tshow the tool version and end" << endl
+      << "\t--epochs\tthe tests are the epochs of the dumps instead of the dumps" << endl
+      << endl
+      << "\t-o\t\tbuild the index from the dumps" << endl
+      << "\t-l\t\tread the dumps from the given file, one per line" << endl
+      << "\t-q\t\tprint the tests hitting the given files or lines" << endl;
+}
+//---------------------------------------------------------------------------
+static void showVersion(const char* argv0)
+   // Show the help
+{
+   cout << argv0 << " " << PACKAGE_VERSION " from package " << PACKAGE_TARNAME << endl;
+}
+//---------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+   // Parse the command line
+   string outputFile,queryFile;
+   bool perEpoch=false;
+   vector<string> inputs;
+   int start=1;
+   while (start<argc) {
+      if (argv[start][0]=='-') {
+         if (strcmp(argv[start],"--help")==0) {
+            showHelp(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--version")==0) {
+            showVersion(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--epochs")==0) {
+            perEpoch=true;
+            start++;
+         } else if ((argv[start][1]=='o')&&(argv[start][2]||(start+1<argc))) {
+            outputFile=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='q')&&(argv[start][2]||(start+1<argc))) {
+            queryFile=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='l')&&(argv[start][2]||(start+1<argc))) {
+            if (!readList(argv[start][2]?(argv[start]+2):argv[++start],inputs))
+               return 1;
+            start++;
+         } else {
+            showHelp(argv[0]);
+            return 1;
+         }
+      } else inputs.push_back(argv[start++]);
+   }
+   if ((inputs.empty())||((outputFile=="")==(queryFile==""))) {
+      showHelp(argv[0]);
+      return 1;
+   }
+
+   // Build an index
+   if (outputFile!="") {
+      IndexBuilder builder(perEpoch);
+      for (vector<string>::const_iterator iter=inputs.begin(),limit=inputs.end();iter!=limit;++iter)
+         if (!builder.add(*iter))
+            return 1;
+      if (!builder.write(outputFile))
+         return 1;
+      cerr << "indexed " << builder.testCount() << " tests" << endl;
+      return 0;
+   }
+
+   // Or query it. Each argument is a file with an optional line range
+   Index index;
+   if (!index.open(queryFile))
+      return 1;
+   vector<Word> result((index.testCount()+63)/64);
+   for (vector<string>::const_iterator iter=inputs.begin(),limit=inputs.end();iter!=limit;++iter) {
+      string file=*iter;
+      unsigned from=0,to=~0u;
+      string::size_type colon=file.rfind(':');
+      if ((colon!=string::npos)&&(colon+1<file.length())&&(file[colon+1]>='0')&&(file[colon+1]<='9')) {
+         char* end;
+         from=to=strtoul(file.c_str()+colon+1,&end,10);
+         if (*end=='-')
+            to=strtoul(end+1,&end,10);
+         file=file.substr(0,colon);
+      }
+      if (!index.query(file,from,to,result)) {
+         cerr << "invalid index " << queryFile << endl;
+         return 1;
+      }
+   }
+   for (unsigned test=0;test<index.testCount();test++)
+      if (result[test/64]&(1ull<<(test%64)))
+         cout << index.testName(test) << endl;
+   return 0;
+}
+//---------------------------------------------------------------------------
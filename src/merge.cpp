@@ -0,0 +1,99 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "Merger.hpp"
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+static void showHelp(const char* argv0)
+   // Show the help
+{
+   cout << "usage: " << argv0 << " [-o output] [-l list] [--text] [dumpfile(s)]" << endl
+      << endl
+      << "\t--help\t\tshow help and end" << endl
+      << "\t--version\tshow the tool version and end" << endl
+      << "\t--text\t\twrite the text format instead of the binary one" << endl
+      << endl
+      << "\t-o\t\tthe merged dump (default .bcovdump)" << endl
+      << "\t-l\t\tread the dumps to merge from the given file, one per line" << endl;
+}
+//---------------------------------------------------------------------------
+static void showVersion(const char* argv0)
+   // Show the help
+{
+   cout << argv0 << " " << PACKAGE_VERSION " from package " << PACKAGE_TARNAME << endl;
+}
+//---------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+   // Parse the command line
+   string outputFile=".bcovdump";
+   DumpWriter::Format format=DumpWriter::Binary;
+   vector<string> inputs;
+   int start=1;
+   while (start<argc) {
+      if (argv[start][0]=='-') {
+         if (strcmp(argv[start],"--help")==0) {
+            showHelp(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--version")==0) {
+            showVersion(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--text")==0) {
+            format=DumpWriter::Text;
+            start++;
+         } else if ((argv[start][1]=='o')&&(argv[start][2]||(start+1<argc))) {
+            outputFile=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='l')&&(argv[start][2]||(start+1<argc))) {
+            if (!readList(argv[start][2]?(argv[start]+2):argv[++start],inputs))
+               return 1;
+            start++;
+         } else {
+            showHelp(argv[0]);
+            return 1;
+         }
+      } else inputs.push_back(argv[start++]);
+   }
+   if (inputs.empty()) {
+      showHelp(argv[0]);
+      return 1;
+   }
+
+   // Merge the inputs one by one
+   Merger merger;
+   for (vector<string>::const_iterator iter=inputs.begin(),limit=inputs.end();iter!=limit;++iter)
+      if (!merger.merge(*iter))
+         return 1;
+
+   // Write the result
+   if (!merger.write(outputFile,format))
+      return 1;
+
+   unsigned totalLines=0,hitLines=0;
+   for (Coverage::const_iterator iter=merger.totals.begin(),limit=merger.totals.end();iter!=limit;++iter) {
+      totalLines+=(*iter).second.lines.size();
+      hitLines+=(*iter).second.hitLines();
+   }
+   cout << "merged " << inputs.size() << " dumps, " << hitLines << " of " << totalLines << " lines hit" << endl;
+   return 0;
+}
+//---------------------------------------------------------------------------
@@ -14,6 +14,9 @@
    along with this program; if not, write to the Free Software
    Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 //---------------------------------------------------------------------------
+#include "Dump.hpp"
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <fstream>
 #include <map>
@@ -21,10 +24,283 @@
 #include <vector>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 //---------------------------------------------------------------------------
 using namespace std;
 //---------------------------------------------------------------------------
+static inline bool needsEscape(unsigned char c)
+   // Does a character need escaping in html?
+{
+   return (c>127)||(c=='<')||(c=='>')||(c=='&')||(c=='\"')||(c=='\n')||(c=='\r');
+}
+//---------------------------------------------------------------------------
+static const char* findEscape(const char* pos,const char* limit)
+   // Find the next character that needs escaping. Skips 16 clean characters at a time
+{
+#if defined(__SSE2__)
+   const __m128i lt=_mm_set1_epi8('<'),gt=_mm_set1_epi8('>'),amp=_mm_set1_epi8('&'),quot=_mm_set1_epi8('\"'),nl=_mm_set1_epi8('\n'),cr=_mm_set1_epi8('\r');
+   for (;limit-pos>=16;pos+=16) {
+      __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+      __m128i special=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,lt),_mm_cmpeq_epi8(v,gt)),_mm_or_si128(_mm_cmpeq_epi8(v,amp),_mm_cmpeq_epi8(v,quot)));
+      special=_mm_or_si128(special,_mm_or_si128(_mm_cmpeq_epi8(v,nl),_mm_cmpeq_epi8(v,cr)));
+      // The sign bit marks the characters above 127
+      unsigned mask=_mm_movemask_epi8(_mm_or_si128(special,v));
+      if (mask)
+         return pos+__builtin_ctz(mask);
+   }
+#endif
+   for (;pos<limit;++pos)
+      if (needsEscape(*pos))
+         return pos;
+   return limit;
+}
+//---------------------------------------------------------------------------
+static unsigned escapeChar(char c,char* buffer)
+   // The replacement of a character that needs escaping. Line breaks are dropped
+{
+   switch (c) {
+      case '<': memcpy(buffer,"&lt;",4); return 4;
+      case '>': memcpy(buffer,"&gt;",4); return 4;
+      case '&': memcpy(buffer,"&amp;",5); return 5;
+      case '\"': memcpy(buffer,"&quot;",6); return 6;
+      case '\n': case '\r': return 0;
+      default: return snprintf(buffer,8,"&#%d;",c&0xFF);
+   }
+}
+//---------------------------------------------------------------------------
+static string escapeHtml(const string& s)
+   // Escape a string for html
+{
+   string result;
+   const char* pos=s.data(),*limit=pos+s.length();
+   while (true) {
+      const char* special=findEscape(pos,limit);
+      result.append(pos,special);
+      if (special==limit)
+         return result;
+      char buffer[8];
+      result.append(buffer,escapeChar(*special,buffer));
+      pos=special+1;
+   }
+}
+//---------------------------------------------------------------------------
+/// A string to be escaped when written
+struct Html
+{
+   /// The string
+   const string& s;
+
+   /// Constructor
+   explicit Html(const string& s) : s(s) {}
+};
+//---------------------------------------------------------------------------
+/// Buffered output of a report file. Writes in large chunks, endl does not flush
+class PageWriter
+{
+   private:
+   /// The file name
+   string fileName;
+   /// The file
+   int fd;
+   /// Did a write fail?
+   bool failed;
+   /// The buffered bytes
+   unsigned fill;
+   /// The bytes written to the file
+   unsigned long long written;
+   /// The buffer
+   char buffer[1<<16];
+
+   /// Write the buffer
+   void flush();
+
+   public:
+   /// Constructor
+   PageWriter() : fd(-1),failed(false),fill(0),written(0) {}
+   /// Destructor
+   ~PageWriter() { close(); }
+
+   /// Create the file
+   bool open(const string& fileName);
+   /// Write the rest and close the file. Reports write errors
+   bool close();
+
+   /// Write bytes
+   void write(const char* data,unsigned long len) {
+      if (len>sizeof(buffer)-fill) {
+         flush();
+         if (len>=sizeof(buffer)) { writeDirect(data,len); return; }
+      }
+      memcpy(buffer+fill,data,len);
+      fill+=len;
+   }
+   /// Write bytes bypassing the buffer
+   void writeDirect(const char* data,unsigned long len);
+   /// Write escaped for html
+   void escape(const char* data,unsigned long len);
+   /// The current output position
+   unsigned long long position() const { return written+fill; }
+   /// Overwrite earlier output of the same length, e.g. a placeholder for totals
+   void patch(unsigned long long offset,const char* data,unsigned len);
+
+   /// Write a string
+   PageWriter& operator<<(const char* s) { write(s,strlen(s)); return *this; }
+   /// Write a string
+   PageWriter& operator<<(const string& s) { write(s.data(),s.length()); return *this; }
+   /// Write a string escaped for html
+   PageWriter& operator<<(const Html& h) { escape(h.s.data(),h.s.length()); return *this; }
+   /// Write a number
+   PageWriter& operator<<(unsigned v) { char b[20]; write(b,snprintf(b,sizeof(b),"%u",v)); return *this; }
+   /// End a line. Only std::endl is passed here
+   PageWriter& operator<<(ostream& (*)(ostream&)) { if (fill==sizeof(buffer)) flush(); buffer[fill++]='\n'; return *this; }
+};
+//---------------------------------------------------------------------------
+bool PageWriter::open(const string& fileName)
+   // Create the file
+{
+   close();
+   this->fileName=fileName;
+   failed=false;
+   fill=0;
+   written=0;
+   fd=::open(fileName.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0666);
+   return fd>=0;
+}
+//---------------------------------------------------------------------------
+void PageWriter::writeDirect(const char* data,unsigned long len)
+   // Write bytes bypassing the buffer
+{
+   while (len&&(!failed)) {
+      ssize_t done=::write(fd,data,len);
+      if (done<0) {
+         if (errno==EINTR) continue;
+         failed=true;
+         break;
+      }
+      data+=done;
+      len-=done;
+      written+=done;
+   }
+}
+//---------------------------------------------------------------------------
+void PageWriter::patch(unsigned long long offset,const char* data,unsigned len)
+   // Overwrite earlier output. Usually it is still in the buffer
+{
+   if (offset<written) {
+      if (offset+len>written)
+         flush();
+      if ((!failed)&&(pwrite(fd,data,len,offset)!=static_cast<ssize_t>(len)))
+         failed=true;
+   } else {
+      memcpy(buffer+(offset-written),data,len);
+   }
+}
+//---------------------------------------------------------------------------
+void PageWriter::flush()
+   // Write the buffer
+{
+   writeDirect(buffer,fill);
+   fill=0;
+}
+//---------------------------------------------------------------------------
+void PageWriter::escape(const char* data,unsigned long len)
+   // Write escaped for html. Clean runs are copied as a whole
+{
+   const char* limit=data+len;
+   while (true) {
+      const char* special=findEscape(data,limit);
+      write(data,special-data);
+      if (special==limit)
+         return;
+      if (sizeof(buffer)-fill<8) flush();
+      fill+=escapeChar(*special,buffer+fill);
+      data=special+1;
+   }
+}
+//---------------------------------------------------------------------------
+bool PageWriter::close()
+   // Write the rest and close the file
+{
+   if (fd<0)
+      return false;
+   flush();
+   if ((::close(fd)!=0)||failed) {
+      cerr << "unable to write " << fileName << endl;
+      fd=-1;
+      return false;
+   }
+   fd=-1;
+   return true;
+}
+//---------------------------------------------------------------------------
+/// A source file mapped into memory
+class MappedFile
+{
+   private:
+   /// The mapping
+   void* mapping;
+
+   MappedFile(const MappedFile&);
+   void operator=(const MappedFile&);
+
+   public:
+   /// The content
+   const char* data;
+   /// The size
+   unsigned long size;
+
+   /// Constructor
+   MappedFile() : mapping(0),data(0),size(0) {}
+   /// Destructor
+   ~MappedFile() { close(); }
+
+   /// Map a file. Files that are not regular files count as empty
+   bool open(const string& fileName);
+   /// Unmap the file
+   void close();
+};
+//---------------------------------------------------------------------------
+bool MappedFile::open(const string& fileName)
+   // Map a file
+{
+   close();
+   int fd=::open(fileName.c_str(),O_RDONLY|O_CLOEXEC);
+   if (fd<0)
+      return false;
+   struct stat info;
+   if ((fstat(fd,&info)==0)&&(S_ISREG(info.st_mode))&&(info.st_size>0)) {
+      void* m=mmap(0,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if (m!=MAP_FAILED) {
+         madvise(m,info.st_size,MADV_SEQUENTIAL);
+         mapping=m;
+         data=static_cast<const char*>(m);
+         size=info.st_size;
+      }
+   }
+   ::close(fd);
+   return true;
+}
+//---------------------------------------------------------------------------
+void MappedFile::close()
+   // Unmap the file
+{
+   if (mapping)
+      munmap(mapping,size);
+   mapping=0;
+   data=0;
+   size=0;
+}
+//---------------------------------------------------------------------------
 /// The complete run information
 struct RunInfo
 {
@@ -34,27 +310,39 @@ struct RunInfo
       /// Number of possible hits
       unsigned hitsPossible;
       /// Number of encountered hits
-      unsigned hits;
+      unsigned hits:30;
+      /// Was any address instrumented?
+      unsigned armed:1;
+      /// Is there coverage information for the line at all?
+      unsigned present:1;
    };
    /// Coverage information about a file
    struct FileInfo
    {
-      /// The lines
-      map<unsigned,LineInfo> lines;
+      /// The lines, indexed by line number
+      vector<LineInfo> lines;
+      /// The hit addresses of lines hit partially, to merge inputs address by address
+      map<unsigned,vector<LineSlots::Word> > partialHits;
       /// Line summary
       unsigned totalLines,hitLines;
       /// Execution point summary
       unsigned totalStatements,hitStatements;
+
+      /// Constructor
+      FileInfo() : totalLines(0),hitLines(0),totalStatements(0),hitStatements(0) {}
    };
    /// Coverage information about a directory
    struct DirInfo
    {
-      /// The files
-      map<string,FileInfo> files;
+      /// The files, positions in the file table
+      map<string,unsigned> files;
       /// Line summary
       unsigned totalLines,hitLines;
       /// Execution point summary
       unsigned totalStatements,hitStatements;
+
+      /// Constructor
+      DirInfo() : totalLines(0),hitLines(0),totalStatements(0),hitStatements(0) {}
    };
 
    /// The command
@@ -63,30 +351,101 @@ struct RunInfo
    string args;
    /// The timestamp
    string timestamp;
+   /// The sampling parameters, if any
+   string sample;
+   /// The shown epoch, if any
+   string epoch;
+   /// The file table. A deque, the entries never move
+   deque<FileInfo> files;
    /// The directories
    map<string,DirInfo> dirs;
 
-   /// Update the aggregated statistics
-   void updateStatistics();
+   /// Reads a dump into the run information
+   class Reader : public DumpReader
+   {
+      private:
+      /// The target
+      RunInfo& run;
+      /// The path filter
+      const string& filterPath;
+      /// The epoch filter
+      const string& epochFilter;
+      /// Reading the requested section?
+      bool inSection;
+      /// The current directory
+      DirInfo* currentDir;
+      /// The current file
+      FileInfo* currentFile;
+
+      /// Release unused space of the current file
+      void finishFile();
+
+      protected:
+      /// The start of a segment
+      void segment();
+      /// A header entry
+      void header(const string& name,const string& value);
+      /// The start of an epoch section
+      bool epoch(const string& name);
+      /// A new source file
+      bool file(const string& name);
+      /// A line of the current file
+      void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots);
+
+      public:
+      /// Did we see the requested epoch?
+      bool foundEpoch;
+
+      /// Constructor
+      Reader(RunInfo& run,const string& filterPath,const string& epochFilter) : run(run),filterPath(filterPath),epochFilter(epochFilter),inSection(epochFilter==""),currentDir(0),currentFile(0),foundEpoch(false) {}
+      /// Destructor
+      ~Reader() { finishFile(); }
+   };
 
    /// Write used png images
    bool writePNGs(const string& outputDirectory);
    /// Write the CSS file
    bool writeCSS(const string& outputDirectory);
    /// Write the header
-   void writeHeader(ofstream& out,const string& title,const string& viewString,unsigned totalLines,unsigned hitLines,unsigned totalStatements,unsigned hitStatements);
+   void writeHeader(PageWriter& out,const string& title,const string& viewString,unsigned totalLines,unsigned hitLines,unsigned totalStatements,unsigned hitStatements);
    /// Write the footer
-   void writeFooter(ofstream& out);
+   void writeFooter(PageWriter& out);
+   /// A file page to write
+   struct FileTask {
+      /// The directory and file name
+      const string* dirName,*fileName;
+      /// The coverage
+      const FileInfo* fileInfo;
+      /// The page numbers
+      unsigned dirId,fileId;
+      /// The hash of the page inputs
+      unsigned long long hash;
+   };
+   /// The pages of a report with the hash of their inputs
+   typedef map<string,unsigned long long> Manifest;
+   /// The file pages of a report, shared by the writer threads
+   class FileTasks;
+
+   /// The hash of everything a file page depends on
+   unsigned long long pageHash(const FileTask& task) const;
+   /// Read the manifest of an earlier report
+   static bool readManifest(const string& outputDirectory,Manifest& pages);
+   /// Write the manifest
+   static bool writeManifest(const string& outputDirectory,const Manifest& pages);
    /// Write a file report
-   bool writeFileReport(const string& outputDirectory,const string& fileName,const FileInfo& fileInfo,const string& dirName,unsigned dirCounter,unsigned& fileCounter);
+   bool writeFileReport(const string& outputDirectory,const string& fileName,const FileInfo& fileInfo,const string& dirName,unsigned dirId,unsigned fileId);
    /// Write a directory report
-   bool writeDirectoryReport(const string& outputDirectory,const string& dirName,const DirInfo& dirInfo,unsigned& dirCounter,unsigned& fileCounter);
+   bool writeDirectoryReport(const string& outputDirectory,const string& dirName,const DirInfo& dirInfo,unsigned dirId,unsigned fileId);
+   /// Remove the pages of the earlier report that are gone and write the manifest
+   static bool finishReport(const string& outputDirectory,const Manifest& previous,const Manifest& pages);
 
    public:
-   /// Read it
-   bool read(const string& file,const string& filterPath);
-   /// Write the report
-   bool writeReport(const string& outputDirectory);
+   /// Read and merge the dumps
+   bool read(const vector<string>& files,const string& filterPath,const string& epochFilter);
+   /// Write the report, the file pages with the given number of threads
+   bool writeReport(const string& outputDirectory,unsigned threads);
+   /// Write the report as a single page with compressed data shards. A maxSize limits the source text
+   bool writeSinglePage(const string& outputDirectory,unsigned long long maxSize);
    /// Delete a written report
    void removeReport(const string& outputDirectory);
 };
@@ -103,90 +462,109 @@ static void splitFileName(const string& s,string& dir,string& name)
    }
 }
 //---------------------------------------------------------------------------
-static void split(const string& s,vector<string>& parts)
-   // Split a string
+void RunInfo::Reader::segment()
+   // The start of a segment, beginning with the totals
+{
+   inSection=(epochFilter=="");
+}
+//---------------------------------------------------------------------------
+void RunInfo::Reader::header(const string& name,const string& value)
+   // A header entry
+{
+   if (name=="command") run.command=value; else
+   if (name=="args") run.args=value; else
+   if (name=="date") run.timestamp=value; else
+   if (name=="sample") run.sample=value;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::Reader::epoch(const string& name)
+   // The start of an epoch section
+{
+   inSection=(name==epochFilter);
+   foundEpoch|=inSection;
+   return inSection;
+}
+//---------------------------------------------------------------------------
+void RunInfo::Reader::finishFile()
+   // Release unused space of the current file. The arrays grow by doubling
 {
-   string delimiters=" ";
-   parts.clear();
-   string::size_type lastPos=s.find_first_not_of(delimiters,0);
-   string::size_type pos=s.find_first_of(delimiters,lastPos);
-   while ((string::npos!=pos)||(string::npos!=lastPos)) {
-      parts.push_back(s.substr(lastPos,pos-lastPos));
-      lastPos=s.find_first_not_of(delimiters,pos);
-      pos=s.find_first_of(delimiters,lastPos);
+   if (currentFile&&(currentFile->lines.capacity()>currentFile->lines.size()+currentFile->lines.size()/8))
+      vector<LineInfo>(currentFile->lines).swap(currentFile->lines);
+   currentFile=0;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::Reader::file(const string& path)
+   // A new source file. Apply the filter
+{
+   finishFile();
+   if ((!inSection)||((filterPath!="")&&(path.compare(0,filterPath.length(),filterPath)!=0)))
+      return false;
+   string dir,name;
+   splitFileName(path,dir,name);
+   currentDir=&(run.dirs[dir]);
+   map<string,unsigned>::iterator iter=currentDir->files.find(name);
+   if (iter==currentDir->files.end()) {
+      iter=currentDir->files.insert(make_pair(name,static_cast<unsigned>(run.files.size()))).first;
+      run.files.push_back(FileInfo());
    }
+   currentFile=&(run.files[(*iter).second]);
+   return true;
 }
 //---------------------------------------------------------------------------
-void RunInfo::updateStatistics()
-   // Update the aggregated statistics
+void RunInfo::Reader::line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots)
+   // A line of the current file. Segments of appended runs are merged address by address, the summaries follow the merged values
 {
-   for (map<string,DirInfo>::iterator iter=dirs.begin(),limit=dirs.end();iter!=limit;++iter) {
-      DirInfo& d=(*iter).second;
-      d.totalLines=d.hitLines=d.totalStatements=d.hitStatements=0;
-      for (map<string,FileInfo>::iterator iter2=d.files.begin(),limit2=d.files.end();iter2!=limit2;++iter2) {
-         FileInfo& f=(*iter2).second;
-         f.totalLines=f.hitLines=f.totalStatements=f.hitStatements=0;
-         for (map<unsigned,LineInfo>::const_iterator iter3=f.lines.begin(),limit3=f.lines.end();iter3!=limit3;++iter3) {
-            const LineInfo& l=(*iter3).second;
-            f.totalLines++;
-            if (l.hits) f.hitLines++;
-            f.totalStatements+=l.hitsPossible;
-            f.hitStatements+=l.hits;
-         }
-         d.totalLines+=f.totalLines;
-         d.hitLines+=f.hitLines;
-         d.totalStatements+=f.totalStatements;
-         d.hitStatements+=f.hitStatements;
-      }
+   vector<LineInfo>& lines=currentFile->lines;
+   if (lineNo>=lines.size()) {
+      LineInfo empty={0,0,0,0};
+      if (lineNo>=lines.capacity())
+         lines.reserve(max<unsigned long>(lineNo+1,2*lines.capacity()));
+      lines.resize(lineNo+1,empty);
+   }
+   LineInfo& line=lines[lineNo];
+   unsigned newPossible=max(line.hitsPossible,hitsPossible),newHits=max<unsigned>(line.hits,hits);
+   if (hits&&(hits<hitsPossible)&&((!line.hits)||(line.hits<line.hitsPossible))) {
+      // Partial hits of different inputs may add up to a complete line
+      vector<LineSlots::Word>& bits=currentFile->partialHits[lineNo];
+      if (bits.size()<slots.hits.size())
+         bits.resize(slots.hits.size(),0);
+      for (unsigned index=0;index<slots.hits.size();index++)
+         bits[index]|=slots.hits[index];
+      newHits=max(newHits,min(LineSlots::count(bits),newPossible));
+      if (newHits>=newPossible)
+         currentFile->partialHits.erase(lineNo);
+   } else if (hits&&(hits>=hitsPossible)) {
+      currentFile->partialHits.erase(lineNo);
    }
+   unsigned newLines=!line.present,newHitLines=(newHits&&(!line.hits));
+   unsigned newStatements=newPossible-line.hitsPossible,newHitStatements=newHits-line.hits;
+   line.hitsPossible=newPossible;
+   line.hits=newHits;
+   line.armed|=(armed!=0);
+   line.present=1;
+
+   currentFile->totalLines+=newLines; currentDir->totalLines+=newLines;
+   currentFile->hitLines+=newHitLines; currentDir->hitLines+=newHitLines;
+   currentFile->totalStatements+=newStatements; currentDir->totalStatements+=newStatements;
+   currentFile->hitStatements+=newHitStatements; currentDir->hitStatements+=newHitStatements;
 }
 //---------------------------------------------------------------------------
-bool RunInfo::read(const string& fileName,const string& filterPath)
-   // Read the dump
+//---------------------------------------------------------------------------
+bool RunInfo::read(const vector<string>& files,const string& filterPath,const string& epochFilter)
+   // Read the dumps, merging them like appended runs. With an epoch filter only that epoch section is used
 {
-   ifstream in(fileName.c_str());
-   if (!in.is_open()) {
-      cerr << "unable to open " << fileName << endl;
+   command=args=timestamp=sample="";
+   epoch=epochFilter;
+   this->files.clear();
+   dirs.clear();
+   Reader reader(*this,filterPath,epochFilter);
+   for (vector<string>::const_iterator iter=files.begin(),limit=files.end();iter!=limit;++iter)
+      if (!reader.read(*iter))
+         return false;
+   if ((epochFilter!="")&&(!reader.foundEpoch)) {
+      cerr << "no epoch " << epochFilter << " in " << files.front() << endl;
       return false;
    }
-   command=args=timestamp="";
-   dirs.clear();
-   FileInfo* currentFile=0;
-   while (!in.eof()) {
-      // Read and strip the current line
-      string currentLine;
-      getline(in,currentLine);
-      while (true) {
-         unsigned l=currentLine.length();
-         if (!l) break;
-         char c=currentLine[l-1];
-         if ((c!='\n')&&(c!='\r')&&(c!=' ')&&(c!='\t')) break;
-         currentLine=currentLine.substr(0,l-1);
-      }
-      if (!currentLine.length()) continue;
-      // Interpret header
-      if (currentLine.compare(0,8,"command ")==0) { command=currentLine.substr(8); continue; }
-      if (currentLine.compare(0,5,"args ")==0) { args=currentLine.substr(5); continue; }
-      if (currentLine.compare(0,5,"date ")==0) { timestamp=currentLine.substr(5); continue; }
-      if (currentLine.compare(0,5,"file ")==0) {
-         string dir,name,path=currentLine.substr(5);
-         // apply filter, set currentFile=0 when supressing
-         if ((filterPath=="") || (path.compare(0,filterPath.length(),filterPath)==0)) {
-            splitFileName(path,dir,name);
-            currentFile=&(dirs[dir].files[name]);
-         } else currentFile=0;
-         continue;
-      }
-      // A regular line
-      if (!currentFile) continue;
-      vector<string> parts;
-      split(currentLine,parts);
-      if (parts.size()!=3) continue;
-      LineInfo& line=currentFile->lines[atoi(parts[0].c_str())];
-      line.hitsPossible=atoi(parts[1].c_str());
-      line.hits=atoi(parts[2].c_str());
-   }
-   updateStatistics();
    return true;
 }
 //---------------------------------------------------------------------------
@@ -201,13 +579,13 @@ static string itoa(int i)
 static bool writeBLOB(const string& fileName,const uint8_t* data,unsigned len)
    // Write binary data to a file
 {
-   ofstream out(fileName.c_str(), ios::out | ios::binary);
-   if (!out.is_open()) {
+   PageWriter out;
+   if (!out.open(fileName)) {
       cerr << "unable to write " << fileName << endl;
       return false;
    }
    out.write(reinterpret_cast<const char*>(data),len);
-   return true;
+   return out.close();
 }
 //---------------------------------------------------------------------------
 bool RunInfo::writePNGs(const string& outputDirectory)
@@ -232,8 +610,8 @@ bool RunInfo::writeCSS(const string& outputDirectory)
    // Write the CSS file
 {
    string outputFile=outputDirectory+"/bcov.css";
-   ofstream out(outputFile.c_str());
-   if (!out.is_open()) {
+   PageWriter out;
+   if (!out.open(outputFile)) {
       cerr << "unable to write " << outputFile << endl;
       return false;
    }
@@ -252,6 +630,7 @@ bool RunInfo::writeCSS(const string& outputDirectory)
        << "span.lineCov { background-color: #CAD7FE; }" << endl
        << "span.linePartCov { background-color: #FFEA20; }" << endl
        << "span.lineNoCov { background-color: #FF6230; }" << endl
+       << "span.lineNoInstr { background-color: #D0D0D0; }" << endl
        << "td.tableHead { text-align: center; color: #FFFFFF; background-color: #6688D4; font-family: sans-serif; font-size: 120%; font-weight: bold; }" << endl
        << "td.coverFile { text-align: left; padding-left: 10px; padding-right: 20px; color: #284FA8; background-color: #DAE7FE; font-family: monospace; }" << endl
        << "td.coverBar { padding-left: 10px; padding-right: 10px; background-color: #DAE7FE; }" << endl
@@ -263,32 +642,10 @@ bool RunInfo::writeCSS(const string& outputDirectory)
        << "td.coverPerLo { text-align: right; padding-left: 10px; padding-right: 10px; background-color: #FF0000; font-weight: bold; }" << endl
        << "td.coverNumLo { text-align: right; padding-left: 10px; padding-right: 10px; background-color: #FF0000; }" << endl
        ;
-   return true;
-}
-//---------------------------------------------------------------------------
-static string escapeHtml(const string& s)
-   // Escape a string for html
-{
-   string result;
-   for (string::const_iterator iter=s.begin(),limit=s.end();iter!=limit;++iter) {
-      char c=*iter;
-      if ((c&0xFF)>127) {
-         result+="&#"; result+=itoa(c&0xFF); result+=";";
-      } else {
-         switch (c) {
-            case '<': result+="&lt;"; break;
-            case '>': result+="&gt;"; break;
-            case '&': result+="&amp;"; break;
-            case '\"': result+="&quot;"; break;
-            case '\n': case '\r': result+" "; break;
-            default: result+=c;
-         }
-      }
-   }
-   return result;
+   return out.close();
 }
 //---------------------------------------------------------------------------
-void RunInfo::writeHeader(ofstream& out,const string& title,const string& viewString,unsigned totalLines,unsigned hitLines,unsigned totalStatements,unsigned hitStatements)
+void RunInfo::writeHeader(PageWriter& out,const string& title,const string& viewString,unsigned totalLines,unsigned hitLines,unsigned totalStatements,unsigned hitStatements)
    // Write the header
 {
    char covered[20];
@@ -296,7 +653,7 @@ void RunInfo::writeHeader(ofstream& out,const string& title,const string& viewSt
    out << "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">" << endl
        << "<html>" << endl
        << "<head>" << endl
-       << "  <title>Coverage - " << escapeHtml(command) << " - " << escapeHtml(title) << "</title>" << endl
+       << "  <title>Coverage - " << Html(command) << " - " << Html(title) << "</title>" << endl
        << "  <link rel=\"stylesheet\" type=\"text/css\" href=\"bcov.css\"/>" << endl
        << "</head>" << endl
        << "<body>" << endl
@@ -312,25 +669,36 @@ void RunInfo::writeHeader(ofstream& out,const string& title,const string& viewSt
        << "        </tr>" << endl
        << "        <tr>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Command:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"80%\" colspan=6>" << escapeHtml(command) << " " << escapeHtml(args) << "</td>" << endl
-       << "        </tr>" << endl
+       << "          <td class=\"headerValue\" width=\"80%\" colspan=6>" << Html(command) << " " << Html(args) << "</td>" << endl
+       << "        </tr>" << endl;
+   if (sample!="")
+      out << "        <tr>" << endl
+          << "          <td class=\"headerItem\" width=\"20%\">Sampled&nbsp;(fraction&nbsp;seed):</td>" << endl
+          << "          <td class=\"headerValue\" width=\"80%\" colspan=6>" << Html(sample) << "</td>" << endl
+          << "        </tr>" << endl;
+   if (epoch!="")
+      out << "        <tr>" << endl
+          << "          <td class=\"headerItem\" width=\"20%\">Epoch:</td>" << endl
+          << "          <td class=\"headerValue\" width=\"80%\" colspan=6>" << Html(epoch) << "</td>" << endl
+          << "        </tr>" << endl;
+   out
        << "        <tr>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Date:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"15%\">" << escapeHtml(timestamp) << "</td>" << endl
+       << "          <td class=\"headerValue\" width=\"15%\">" << Html(timestamp) << "</td>" << endl
        << "          <td width=\"5%\"></td>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Instrumented&nbsp;lines:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"10%\">" << itoa(totalLines) << "</td>" << endl
+       << "          <td class=\"headerValue\" width=\"10%\">" << totalLines << "</td>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Instrumented&nbsp;statements:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"10%\">" << itoa(totalStatements) << "</td>" << endl
+       << "          <td class=\"headerValue\" width=\"10%\">" << totalStatements << "</td>" << endl
        << "        </tr>" << endl
        << "        <tr>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Code&nbsp;covered:</td>" << endl
        << "          <td class=\"headerValue\" width=\"15%\">" << covered << " %</td>" << endl
        << "          <td width=\"5%\"></td>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Executed&nbsp;lines:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"10%\">" << itoa(hitLines) << "</td>" << endl
+       << "          <td class=\"headerValue\" width=\"10%\">" << hitLines << "</td>" << endl
        << "          <td class=\"headerItem\" width=\"20%\">Executed&nbsp;statements:</td>" << endl
-       << "          <td class=\"headerValue\" width=\"10%\">" << itoa(hitStatements) << "</td>" << endl
+       << "          <td class=\"headerValue\" width=\"10%\">" << hitStatements << "</td>" << endl
        << "        </tr>" << endl
        << "      </table>" << endl
        << "    </td>" << endl
@@ -339,7 +707,7 @@ void RunInfo::writeHeader(ofstream& out,const string& title,const string& viewSt
        << "</table>" << endl;
 }
 //---------------------------------------------------------------------------
-void RunInfo::writeFooter(ofstream& out)
+void RunInfo::writeFooter(PageWriter& out)
    // Write the footer
 {
    out << "<table width=\"100%\" border=\"0\" cellspacing=\"0\" cellpadding=\"0\">" << endl
@@ -351,65 +719,267 @@ void RunInfo::writeFooter(ofstream& out)
        << "</html>" << endl;
 }
 //---------------------------------------------------------------------------
-bool RunInfo::writeFileReport(const string& outputDirectory,const string& fileName,const FileInfo& fileInfo,const string& dirName,unsigned dirCounter,unsigned& fileCounter)
-   // Write a file report
+static void removeFile(const string& dir,const string& name)
+   // Remove a file
 {
-   string outName=outputDirectory+"/file"+itoa(fileCounter++)+".html";
-   ofstream out(outName.c_str());
+   string fullName=dir+"/"+name;
+   unlink(fullName.c_str());
+}
+//---------------------------------------------------------------------------
+/// The manifest of a report directory
+static const char manifestName[]="bcov-manifest";
+/// The version of the page layout, change it whenever the generated html changes
+static const unsigned templateVersion=1;
+/// The helper files of a report
+static const char* const helperFiles[]={"bcov.css","ruby.png","amber.png","emerald.png","snow.png","glass.png"};
+/// The directory of the data shards of a single page report
+static const char dataDirectory[]="data";
+/// The size of the uncompressed data shards
+static const unsigned shardSize=1<<20;
+/// The script of a single page report. Shards are loaded as scripts, which also works for file:// urls
+static const char singlePageScript[]=
+   "var bcovShards={},bcovPending={};\n"
+   "function bcovShard(id,data) {\n"
+   "   var raw=atob(data),bytes=new Uint8Array(raw.length);\n"
+   "   for (var i=0;i<raw.length;i++) bytes[i]=raw.charCodeAt(i);\n"
+   "   new Response(new Blob([bytes]).stream().pipeThrough(new DecompressionStream(\"gzip\"))).text().then(function(text) { bcovPending[id](JSON.parse(text)); });\n"
+   "}\n"
+   "function loadShard(id) {\n"
+   "   if (!(id in bcovShards))\n"
+   "      bcovShards[id]=new Promise(function(resolve,reject) {\n"
+   "         bcovPending[id]=resolve;\n"
+   "         var script=document.createElement(\"script\");\n"
+   "         script.src=\"data/shard\"+id+\".js\";\n"
+   "         script.onerror=reject;\n"
+   "         document.head.appendChild(script);\n"
+   "      });\n"
+   "   return bcovShards[id];\n"
+   "}\n"
+   "function escapeHtml(s) { return s.replace(/&/g,\"&amp;\").replace(/</g,\"&lt;\").replace(/>/g,\"&gt;\").replace(/\"/g,\"&quot;\"); }\n"
+   "function constructBar(p) {\n"
+   "   var color=(p>=50)?\"emerald.png\":((p>=15)?\"amber.png\":\"ruby.png\"),width=Math.floor(p+0.5),alt=p.toFixed(1)+\"%\";\n"
+   "   if (width<1) return '<img src=\"snow.png\" width=\"100\" height=\"10\" alt=\"0.0%\"/>';\n"
+   "   if (width>=100) return '<img src=\"'+color+'\" width=\"100\" height=\"10\" alt=\"100.0%\"/>';\n"
+   "   return '<img src=\"'+color+'\" width=\"'+width+'\" height=\"10\" alt=\"'+alt+'\"/><img src=\"snow.png\" width=\"'+(100-width)+'\" height=\"10\" alt=\"'+alt+'\"/>';\n"
+   "}\n"
+   "function coverTable(head,rows) {\n"
+   "   var out=['<center>','  <table width=\"80%\" cellpadding=\"2\" cellspacing=\"1\" border=\"0\">',\n"
+   "      '    <tr><td width=\"50%\"><br/></td><td width=\"15%\"></td><td width=\"15%\"></td><td width=\"20%\"></td></tr>',\n"
+   "      '    <tr><td class=\"tableHead\">'+head+'</td><td class=\"tableHead\" colspan=\"3\">Coverage</td></tr>'];\n"
+   "   rows.forEach(function(row) {\n"
+   "      var total=row[2],hit=row[3],p=total?(100*hit/total):0,qc=(p>=50)?\"Hi\":((p>=15)?\"Med\":\"Lo\");\n"
+   "      out.push('    <tr>','      <td class=\"coverFile\"><a href=\"'+row[0]+'\">'+escapeHtml(row[1])+'</a></td>',\n"
+   "         '      <td class=\"coverBar\" align=\"center\"><table border=\"0\" cellspacing=\"0\" cellpadding=\"1\"><tr><td class=\"coverBarOutline\">'+constructBar(p)+'</td></tr></table></td>',\n"
+   "         '      <td class=\"coverPer'+qc+'\">'+p.toFixed(1)+'&nbsp;%</td>',\n"
+   "         '      <td class=\"coverNum'+qc+'\">'+hit+'&nbsp;/&nbsp;'+total+'&nbsp;lines</td>','    </tr>');\n"
+   "   });\n"
+   "   out.push('  </table>','</center>','<br/>');\n"
+   "   return out.join(\"\\n\");\n"
+   "}\n"
+   "function renderSource(lines,source) {\n"
+   "   var covered={};\n"
+   "   for (var i=0;i<lines.length;i+=4) covered[lines[i]]=i;\n"
+   "   var text=source.split(\"\\n\");\n"
+   "   if (text.length&&(text[text.length-1]===\"\")) text.pop();\n"
+   "   var out=['<pre class=\"source\">'];\n"
+   "   for (var lineNo=1;lineNo<=text.length;lineNo++) {\n"
+   "      var line='<span class=\"lineNum\">'+String(lineNo).padStart(8)+' </span>',k=covered[lineNo];\n"
+   "      if (k===undefined) {\n"
+   "         line+=\"            \";\n"
+   "      } else {\n"
+   "         var possible=lines[k+1],hits=lines[k+2],armed=lines[k+3];\n"
+   "         var cls=(hits==possible)?\"lineCov\":(hits?\"linePartCov\":((!armed)?\"lineNoInstr\":\"lineNoCov\"));\n"
+   "         line+='<span class=\"'+cls+'\">'+(((!armed)&&(!hits))?(\"- / \"+possible+\" \"):(hits+\" / \"+possible+\" \")).padStart(12);\n"
+   "      }\n"
+   "      line+=\" : \"+escapeHtml(text[lineNo-1].replace(/[\\r \\t]+$/,\"\").replace(/\\r/g,\"\"));\n"
+   "      if (k!==undefined) line+=\"</span>\";\n"
+   "      out.push(line);\n"
+   "   }\n"
+   "   out.push(\"</pre>\");\n"
+   "   return out.join(\"\\n\");\n"
+   "}\n"
+   "function dirName(d) { return bcovIndex.dirs[d][0]||\".\"; }\n"
+   "function showIndex(view,body) {\n"
+   "   view.innerHTML=\"directory\";\n"
+   "   body.innerHTML=coverTable(\"Directory\",bcovIndex.dirs.map(function(d,index) { return [\"#d\"+index,d[0]||\".\",d[1],d[2]]; }));\n"
+   "}\n"
+   "function showDir(d,view,body) {\n"
+   "   view.innerHTML='<a href=\"#\">directory</a> - '+escapeHtml(dirName(d));\n"
+   "   var rows=[];\n"
+   "   bcovIndex.files.forEach(function(f,index) { if (f[1]==d) rows.push([\"#f\"+index,f[0],f[3],f[4]]); });\n"
+   "   body.innerHTML=coverTable(\"Filename\",rows);\n"
+   "}\n"
+   "function showFile(id,view,body) {\n"
+   "   var f=bcovIndex.files[id];\n"
+   "   view.innerHTML='<a href=\"#\">directory</a> - <a href=\"#d'+f[1]+'\">'+escapeHtml(dirName(f[1]))+'</a> - '+escapeHtml(f[0]);\n"
+   "   body.innerHTML=\"<br/><h4>Loading...</h4><br/>\";\n"
+   "   loadShard(f[2]).then(function(shard) {\n"
+   "      var entry=shard[id];\n"
+   "      if (entry.missing) return \"<br/><h4>No source code found!</h4><br/>\";\n"
+   "      if (entry.omitted) return \"<br/><h4>Source left out to limit the report size</h4><br/>\";\n"
+   "      if (entry.sourceOf===undefined) return renderSource(entry.lines,entry.source);\n"
+   "      return loadShard(bcovIndex.files[entry.sourceOf][2]).then(function(other) { return renderSource(entry.lines,other[entry.sourceOf].source); });\n"
+   "   }).then(function(html) {\n"
+   "      if (location.hash==\"#f\"+id) body.innerHTML=html;\n"
+   "   },function() { body.innerHTML=\"<br/><h4>Unable to load the coverage data</h4><br/>\"; });\n"
+   "}\n"
+   "function show() {\n"
+   "   var view=document.getElementById(\"bcovView\"),body=document.getElementById(\"bcovBody\"),hash=location.hash,id=parseInt(hash.substring(2));\n"
+   "   if ((hash.charAt(1)==\"d\")&&(id<bcovIndex.dirs.length)) showDir(id,view,body); else\n"
+   "   if ((hash.charAt(1)==\"f\")&&(id<bcovIndex.files.length)) showFile(id,view,body); else\n"
+   "      showIndex(view,body);\n"
+   "   window.scrollTo(0,0);\n"
+   "}\n"
+   "window.onhashchange=show;\n"
+   "show();\n";
+//---------------------------------------------------------------------------
+static void hashString(unsigned long long& hash,const string& s)
+   // Add a string including its length to a hash
+{
+   unsigned long len=s.length();
+   hashBytes(hash,&len,sizeof(len));
+   hashBytes(hash,s.data(),len);
+}
+//---------------------------------------------------------------------------
+unsigned long long RunInfo::pageHash(const FileTask& task) const
+   // The hash of everything a file page depends on. The date is left out, unchanged pages keep the date of their run
+{
+   unsigned long long hash=hashStart;
+   hashBytes(hash,&templateVersion,sizeof(templateVersion));
+   hashString(hash,command);
+   hashString(hash,args);
+   hashString(hash,sample);
+   hashString(hash,epoch);
+   hashString(hash,*task.dirName);
+   hashString(hash,*task.fileName);
+   hashBytes(hash,&task.dirId,sizeof(task.dirId));
+   const vector<LineInfo>& lines=task.fileInfo->lines;
+   for (unsigned lineNo=0;lineNo<lines.size();lineNo++)
+      if (lines[lineNo].present) {
+         unsigned line[4]={lineNo,lines[lineNo].hitsPossible,lines[lineNo].hits,lines[lineNo].armed};
+         hashBytes(hash,line,sizeof(line));
+      }
+   unsigned totals[4]={task.fileInfo->totalLines,task.fileInfo->hitLines,task.fileInfo->totalStatements,task.fileInfo->hitStatements};
+   hashBytes(hash,totals,sizeof(totals));
+
+   // And the source itself
+   MappedFile source;
+   if (!source.open(*task.dirName+"/"+*task.fileName)) {
+      hashBytes(hash,"-",1);
+      return hash;
+   }
+   hashBytes(hash,source.data,source.size);
+   return hash;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::readManifest(const string& outputDirectory,Manifest& pages)
+   // Read the manifest of an earlier report
+{
+   string fileName=outputDirectory+"/"+manifestName;
+   ifstream in(fileName.c_str());
+   if (!in.is_open())
+      return false;
+   string line;
+   if ((!getline(in,line))||(line!=string(manifestName)+" 1"))
+      return false;
+   while (getline(in,line)) {
+      string::size_type split=line.find(' ');
+      if (split==string::npos)
+         continue;
+      // Only pages directly in the report or its data directory
+      string name=line.substr(0,split),dataPrefix=string(dataDirectory)+"/";
+      if (name.compare(0,dataPrefix.length(),dataPrefix)==0)
+         name=name.substr(dataPrefix.length());
+      if ((name.find('/')!=string::npos)||(name=="")||(name==".")||(name==".."))
+         continue;
+      pages[line.substr(0,split)]=strtoull(line.c_str()+split+1,0,16);
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::writeManifest(const string& outputDirectory,const Manifest& pages)
+   // Write the manifest. Replaced atomically, an interrupted run leaves the old one
+{
+   string fileName=outputDirectory+"/"+manifestName,tempName=fileName+".new";
+   ofstream out(tempName.c_str());
    if (!out.is_open()) {
+      cerr << "unable to write " << tempName << endl;
+      return false;
+   }
+   out << manifestName << " 1" << endl;
+   for (Manifest::const_iterator iter=pages.begin(),limit=pages.end();iter!=limit;++iter) {
+      char hash[20];
+      snprintf(hash,sizeof(hash),"%016llx",(*iter).second);
+      out << (*iter).first << " " << hash << endl;
+   }
+   out.close();
+   if ((!out)||(rename(tempName.c_str(),fileName.c_str())!=0)) {
+      cerr << "unable to write " << fileName << endl;
+      return false;
+   }
+   return true;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::writeFileReport(const string& outputDirectory,const string& fileName,const FileInfo& fileInfo,const string& dirName,unsigned dirId,unsigned fileId)
+   // Write a file report
+{
+   string outName=outputDirectory+"/file"+itoa(fileId)+".html";
+   PageWriter out;
+   if (!out.open(outName)) {
       cerr << "unable to write " << outName << endl;
       return false;
    }
 
    // Write the header
    string fullName = dirName+"/"+fileName;
-   string view = "<a href=\"index.html\">directory</a> - <a href=\"dir"+itoa(dirCounter)+".html\">"+escapeHtml(dirName)+"</a> - "+escapeHtml(fileName);
+   string view = "<a href=\"index.html\">directory</a> - <a href=\"dir"+itoa(dirId)+".html\">"+escapeHtml(dirName)+"</a> - "+escapeHtml(fileName);
    writeHeader(out,fullName,view,fileInfo.totalLines,fileInfo.hitLines,fileInfo.totalStatements,fileInfo.hitStatements);
 
-   // Write the file itself
-   ifstream in(fullName.c_str());
-   if (!in.is_open()) {
+   // Write the file itself, walking the covered lines along
+   MappedFile source;
+   if (!source.open(fullName)) {
       out << "<br/><h4>No source code found!</h4><br/>" << endl;
    } else {
       out << "<pre class=\"source\">" << endl;
       unsigned lineNo=0;
-      while (!in.eof()) {
-         // Read and strip the current line
-         string currentLine;
-         getline(in,currentLine);
-         if ((!currentLine.length())&&(in.eof())) break;
-         while (true) {
-            unsigned l=currentLine.length();
-            if (!l) break;
-            char c=currentLine[l-1];
-            if ((c!='\n')&&(c!='\r')&&(c!=' ')&&(c!='\t')) break;
-            currentLine=currentLine.substr(0,l-1);
-         }
+      for (const char* pos=source.data,*sourceLimit=pos+source.size;pos<sourceLimit;) {
+         // Find and strip the current line
+         const char* lineEnd=static_cast<const char*>(memchr(pos,'\n',sourceLimit-pos));
+         if (!lineEnd) lineEnd=sourceLimit;
+         const char* textEnd=lineEnd;
+         while ((textEnd>pos)&&((textEnd[-1]=='\r')||(textEnd[-1]==' ')||(textEnd[-1]=='\t')))
+            --textEnd;
          // Write the line number
          char buffer[50];
          snprintf(buffer,sizeof(buffer),"%8u ",++lineNo);
          out << "<span class=\"lineNum\">" << buffer << "</span>";
          // Write the hit information
-         map<unsigned,LineInfo>::const_iterator iter=fileInfo.lines.find(lineNo);
-         if (iter==fileInfo.lines.end()) {
+         const LineInfo* info=(lineNo<fileInfo.lines.size())&&(fileInfo.lines[lineNo].present)?&fileInfo.lines[lineNo]:0;
+         bool covered=info;
+         if (!covered) {
             out << "            ";
          } else {
-            if ((*iter).second.hits==(*iter).second.hitsPossible)
+            if (info->hits==info->hitsPossible)
                out << "<span class=\"lineCov\">"; else
-            if ((*iter).second.hits)
+            if (info->hits)
                out << "<span class=\"linePartCov\">"; else
+            if (!info->armed)
+               out << "<span class=\"lineNoInstr\">"; else
                out << "<span class=\"lineNoCov\">";
-            snprintf(buffer,sizeof(buffer),"%u / %u ",(*iter).second.hits,(*iter).second.hitsPossible);
+            if ((!info->armed)&&(!info->hits))
+               snprintf(buffer,sizeof(buffer),"- / %u ",info->hitsPossible); else
+               snprintf(buffer,sizeof(buffer),"%u / %u ",info->hits,info->hitsPossible);
             for (unsigned index=strlen(buffer);index<12;index++)
                out << " ";
             out << buffer;
          }
          // Write the line itself
          out << " : ";
-         out << escapeHtml(currentLine);
-         if (iter!=fileInfo.lines.end())
+         out.escape(pos,textEnd-pos);
+         if (covered)
             out << "</span>";
          out << endl;
+         pos=lineEnd+1;
       }
       out << "</pre>" << endl;
    }
@@ -417,7 +987,171 @@ bool RunInfo::writeFileReport(const string& outputDirectory,const string& fileNa
    // Write the footer
    writeFooter(out);
 
-   return true;
+   return out.close();
+}
+//---------------------------------------------------------------------------
+/// The file pages of a report. Each thread works on its own range of pages
+/// and steals half of the remaining pages of another thread when done
+class RunInfo::FileTasks
+{
+   private:
+   /// The pages of a thread
+   struct Range {
+      /// Protects the range
+      pthread_mutex_t lock;
+      /// The remaining pages
+      unsigned begin,end;
+   };
+   /// A thread
+   struct Worker {
+      /// The pages
+      FileTasks* tasks;
+      /// The thread number
+      unsigned id;
+      /// Did a page fail?
+      bool failed;
+      /// Number of pages that were up to date
+      unsigned skipped;
+   };
+
+   /// The report
+   RunInfo& report;
+   /// The output directory
+   const string& outputDirectory;
+   /// The pages
+   vector<FileTask> tasks;
+   /// The ranges of the threads
+   vector<Range> ranges;
+   /// The pages of the earlier report
+   const Manifest& previous;
+
+   /// Take the next page of a thread
+   bool take(unsigned id,unsigned& task);
+   /// Steal pages from another thread
+   bool steal(unsigned id,unsigned& task);
+   /// The body of a thread
+   static void* work(void* worker);
+
+   public:
+   /// Constructor
+   FileTasks(RunInfo& report,const string& outputDirectory,const Manifest& previous) : report(report),outputDirectory(outputDirectory),previous(previous) {}
+
+   /// The number of pages
+   unsigned size() const { return tasks.size(); }
+   /// Add a page
+   void add(const FileTask& task) { tasks.push_back(task); }
+   /// Write all pages that changed
+   bool run(unsigned threads,unsigned& skipped);
+   /// The pages and their hashes
+   void addTo(Manifest& pages) const;
+};
+//---------------------------------------------------------------------------
+bool RunInfo::FileTasks::take(unsigned id,unsigned& task)
+   // Take the next page of a thread
+{
+   Range& range=ranges[id];
+   pthread_mutex_lock(&range.lock);
+   bool found=(range.begin<range.end);
+   if (found)
+      task=range.begin++;
+   pthread_mutex_unlock(&range.lock);
+   return found;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::FileTasks::steal(unsigned id,unsigned& task)
+   // Steal the upper half of the remaining pages of another thread
+{
+   for (unsigned index=1;index<ranges.size();index++) {
+      Range& victim=ranges[(id+index)%ranges.size()];
+      pthread_mutex_lock(&victim.lock);
+      unsigned begin=victim.begin,end=victim.end;
+      if (begin<end) {
+         begin=end-(end-begin+1)/2;
+         victim.end=begin;
+      }
+      pthread_mutex_unlock(&victim.lock);
+      if (begin<end) {
+         Range& own=ranges[id];
+         pthread_mutex_lock(&own.lock);
+         task=begin;
+         own.begin=begin+1;
+         own.end=end;
+         pthread_mutex_unlock(&own.lock);
+         return true;
+      }
+   }
+   return false;
+}
+//---------------------------------------------------------------------------
+void* RunInfo::FileTasks::work(void* data)
+   // The body of a thread
+{
+   Worker& worker=*static_cast<Worker*>(data);
+   FileTasks& tasks=*worker.tasks;
+   unsigned next;
+   while (tasks.take(worker.id,next)||tasks.steal(worker.id,next)) {
+      FileTask& task=tasks.tasks[next];
+      // Skip pages whose inputs did not change
+      task.hash=tasks.report.pageHash(task);
+      string name="file"+itoa(task.fileId)+".html";
+      Manifest::const_iterator old=tasks.previous.find(name);
+      if ((old!=tasks.previous.end())&&((*old).second==task.hash)&&(access((tasks.outputDirectory+"/"+name).c_str(),F_OK)==0)) {
+         worker.skipped++;
+         continue;
+      }
+      if (!tasks.report.writeFileReport(tasks.outputDirectory,*task.fileName,*task.fileInfo,*task.dirName,task.dirId,task.fileId))
+         worker.failed=true;
+   }
+   return 0;
+}
+//---------------------------------------------------------------------------
+void RunInfo::FileTasks::addTo(Manifest& pages) const
+   // The pages and their hashes
+{
+   for (vector<FileTask>::const_iterator iter=tasks.begin(),limit=tasks.end();iter!=limit;++iter)
+      pages["file"+itoa((*iter).fileId)+".html"]=(*iter).hash;
+}
+//---------------------------------------------------------------------------
+bool RunInfo::FileTasks::run(unsigned threads,unsigned& skipped)
+   // Write all pages that changed. The page numbers are fixed, the output does not depend on the order
+{
+   skipped=0;
+   if (!threads)
+      threads=1;
+   if (threads>tasks.size())
+      threads=tasks.size();
+   if (!threads)
+      return true;
+
+   // Split the pages evenly
+   ranges.resize(threads);
+   vector<Worker> workers(threads);
+   for (unsigned index=0;index<threads;index++) {
+      pthread_mutex_init(&ranges[index].lock,0);
+      ranges[index].begin=(static_cast<unsigned long>(tasks.size())*index)/threads;
+      ranges[index].end=(static_cast<unsigned long>(tasks.size())*(index+1))/threads;
+      workers[index].tasks=this;
+      workers[index].id=index;
+      workers[index].failed=false;
+      workers[index].skipped=0;
+   }
+
+   // The calling thread is the first worker
+   vector<pthread_t> ids(threads);
+   unsigned started=1;
+   for (;started<threads;started++)
+      if (pthread_create(&ids[started],0,work,&workers[started])!=0)
+         break;
+   work(&workers[0]);
+   bool result=true;
+   for (unsigned index=1;index<started;index++)
+      pthread_join(ids[index],0);
+   for (unsigned index=0;index<threads;index++) {
+      result&=!workers[index].failed;
+      skipped+=workers[index].skipped;
+      pthread_mutex_destroy(&ranges[index].lock);
+   }
+   return result;
 }
 //---------------------------------------------------------------------------
 static string constructBar(double percent)
@@ -440,19 +1174,12 @@ static string constructBar(double percent)
    return string(buffer);
 }
 //---------------------------------------------------------------------------
-bool RunInfo::writeDirectoryReport(const string& outputDirectory,const string& dirName,const DirInfo& dirInfo,unsigned& dirCounter,unsigned& fileCounter)
-   // Write a directory report
+bool RunInfo::writeDirectoryReport(const string& outputDirectory,const string& dirName,const DirInfo& dirInfo,unsigned dirId,unsigned fileId)
+   // Write a directory report. Its files are numbered from fileId on
 {
-   // Write the files first
-   unsigned fileId=fileCounter;
-   for (map<string,FileInfo>::const_iterator iter=dirInfo.files.begin(),limit=dirInfo.files.end();iter!=limit;++iter)
-      if (!writeFileReport(outputDirectory,(*iter).first,(*iter).second,dirName,dirCounter,fileCounter))
-         return false;
-
-   // Now write the directory page
-   string outName=outputDirectory+"/dir"+itoa(dirCounter++)+".html";
-   ofstream out(outName.c_str());
-   if (!out.is_open()) {
+   string outName=outputDirectory+"/dir"+itoa(dirId)+".html";
+   PageWriter out;
+   if (!out.open(outName)) {
       cerr << "unable to write " << outName << endl;
       return false;
    }
@@ -474,8 +1201,9 @@ bool RunInfo::writeDirectoryReport(const string& outputDirectory,const string& d
        << "      <td class=\"tableHead\">Filename</td>" << endl
        << "      <td class=\"tableHead\" colspan=\"3\">Coverage</td>" << endl
        << "    </tr>" << endl;
-   for (map<string,FileInfo>::const_iterator iter=dirInfo.files.begin(),limit=dirInfo.files.end();iter!=limit;++iter) {
-      double percentage=(*iter).second.totalLines?(static_cast<double>(100*(*iter).second.hitLines)/(*iter).second.totalLines):0.0;
+   for (map<string,unsigned>::const_iterator iter=dirInfo.files.begin(),limit=dirInfo.files.end();iter!=limit;++iter) {
+      const FileInfo& fileInfo=files[(*iter).second];
+      double percentage=fileInfo.totalLines?(static_cast<double>(100*fileInfo.hitLines)/fileInfo.totalLines):0.0;
       string qc;
       if (percentage>=50) qc="Hi"; else
       if (percentage>=15) qc="Med"; else
@@ -484,12 +1212,12 @@ bool RunInfo::writeDirectoryReport(const string& outputDirectory,const string& d
       snprintf(percentageText,sizeof(percentageText),"%.1f",percentage);
       out
        << "    <tr>" << endl
-       << "      <td class=\"coverFile\"><a href=\"file"+itoa(fileId++)+".html\">"+escapeHtml((*iter).first)+"</a></td>" << endl
+       << "      <td class=\"coverFile\"><a href=\"file" << fileId++ << ".html\">" << Html((*iter).first) << "</a></td>" << endl
        << "      <td class=\"coverBar\" align=\"center\">" << endl
        << "        <table border=\"0\" cellspacing=\"0\" cellpadding=\"1\"><tr><td class=\"coverBarOutline\">" << constructBar(percentage) << "</td></tr></table>" << endl
        << "      </td>" << endl
        << "      <td class=\"coverPer" << qc << "\">" << percentageText << "&nbsp;%</td>" << endl
-       << "      <td class=\"coverNum" << qc << "\">" << (*iter).second.hitLines << "&nbsp;/&nbsp;" << (*iter).second.totalLines << "&nbsp;lines</td>" << endl
+       << "      <td class=\"coverNum" << qc << "\">" << fileInfo.hitLines << "&nbsp;/&nbsp;" << fileInfo.totalLines << "&nbsp;lines</td>" << endl
        << "    </tr>" << endl;
    }
    out << "  </table>" << endl
@@ -499,22 +1227,42 @@ bool RunInfo::writeDirectoryReport(const string& outputDirectory,const string& d
    // Write the footer
    writeFooter(out);
 
-   return true;
+   return out.close();
 }
 //---------------------------------------------------------------------------
-bool RunInfo::writeReport(const string& outputDirectory)
+bool RunInfo::writeReport(const string& outputDirectory,unsigned threads)
    // Write the report
 {
    // Dump the helper files
    if ((!writeCSS(outputDirectory))||(!writePNGs(outputDirectory)))
       return false;
 
-   // Write the directories first
+   // Number the pages in the serial order
+   Manifest previous,pages;
+   readManifest(outputDirectory,previous);
+   FileTasks tasks(*this,outputDirectory,previous);
+   unsigned dirId=0;
+   for (map<string,DirInfo>::const_iterator iter=dirs.begin(),limit=dirs.end();iter!=limit;++iter,++dirId)
+      for (map<string,unsigned>::const_iterator iter2=(*iter).second.files.begin(),limit2=(*iter).second.files.end();iter2!=limit2;++iter2) {
+         FileTask task={&(*iter).first,&(*iter2).first,&files[(*iter2).second],dirId,static_cast<unsigned>(tasks.size()),0};
+         tasks.add(task);
+      }
+
+   // Write the file pages that changed, the other pages need only the summaries
+   unsigned skipped;
+   if (!tasks.run(threads,skipped))
+      return false;
+   if (skipped)
+      cerr << skipped << " of " << tasks.size() << " file pages are up to date" << endl;
+   tasks.addTo(pages);
+
+   // Then the directories
    unsigned dirCounter=0,fileCounter=0;
    unsigned totalLines=0,hitLines=0,totalStatements=0,hitStatements=0;
    for (map<string,DirInfo>::const_iterator iter=dirs.begin(),limit=dirs.end();iter!=limit;++iter) {
-      if (!writeDirectoryReport(outputDirectory,(*iter).first,(*iter).second,dirCounter,fileCounter))
+      if (!writeDirectoryReport(outputDirectory,(*iter).first,(*iter).second,dirCounter++,fileCounter))
          return false;
+      fileCounter+=(*iter).second.files.size();
       totalLines+=(*iter).second.totalLines;
       hitLines+=(*iter).second.hitLines;
       totalStatements+=(*iter).second.totalStatements;
@@ -523,8 +1271,8 @@ bool RunInfo::writeReport(const string& outputDirectory)
 
    // Now write the index page
    string outName=outputDirectory+"/index.html";
-   ofstream out(outName.c_str());
-   if (!out.is_open()) {
+   PageWriter out;
+   if (!out.open(outName)) {
       cerr << "unable to write " << outName << endl;
       return false;
    }
@@ -559,7 +1307,7 @@ bool RunInfo::writeReport(const string& outputDirectory)
       snprintf(percentageText,sizeof(percentageText),"%.1f",percentage);
       out
        << "    <tr>" << endl
-       << "      <td class=\"coverFile\"><a href=\"dir"+itoa(dirCounter++)+".html\">"+escapeHtml(dirName)+"</a></td>" << endl
+       << "      <td class=\"coverFile\"><a href=\"dir" << dirCounter++ << ".html\">" << Html(dirName) << "</a></td>" << endl
        << "      <td class=\"coverBar\" align=\"center\">" << endl
        << "        <table border=\"0\" cellspacing=\"0\" cellpadding=\"1\"><tr><td class=\"coverBarOutline\">" << constructBar(percentage) << "</td></tr></table>" << endl
        << "      </td>" << endl
@@ -573,38 +1321,231 @@ bool RunInfo::writeReport(const string& outputDirectory)
 
    // Write the footer
    writeFooter(out);
+   if (!out.close())
+      return false;
 
+   // Record the pages, pages of the earlier report that are gone are removed
+   for (unsigned index=0;index<sizeof(helperFiles)/sizeof(helperFiles[0]);index++)
+      pages[helperFiles[index]]=0;
+   for (unsigned index=0;index<dirs.size();index++)
+      pages["dir"+itoa(index)+".html"]=0;
+   pages["index.html"]=0;
+   return finishReport(outputDirectory,previous,pages);
+}
+//---------------------------------------------------------------------------
+bool RunInfo::finishReport(const string& outputDirectory,const Manifest& previous,const Manifest& pages)
+   // Remove the pages of the earlier report that are gone and write the manifest
+{
+   for (Manifest::const_iterator iter=previous.begin(),limit=previous.end();iter!=limit;++iter)
+      if (!pages.count((*iter).first))
+         removeFile(outputDirectory,(*iter).first);
+   rmdir((outputDirectory+"/"+dataDirectory).c_str());
+   return writeManifest(outputDirectory,pages);
+}
+//---------------------------------------------------------------------------
+static void appendJson(string& out,const char* data,unsigned long len)
+   // Append a JSON string. Bytes above 127 are characters of their own like in the html pages
+{
+   static const char hex[]="0123456789abcdef";
+   out+='"';
+   for (const char* limit=data+len;data<limit;++data) {
+      unsigned char c=*data;
+      if ((c<32)||(c>127)||(c=='"')||(c=='\\')||(c=='<')) {
+         if (c=='"') out+="\\\""; else
+         if (c=='\\') out+="\\\\"; else
+         if (c=='\n') out+="\\n"; else
+         if (c=='\t') out+="\\t"; else {
+            char buffer[7]={'\\','u','0','0',hex[c>>4],hex[c&15],0};
+            out+=buffer;
+         }
+      } else out+=static_cast<char>(c);
+   }
+   out+='"';
+}
+//---------------------------------------------------------------------------
+static void appendJson(string& out,const string& s)
+   // Append a JSON string
+{
+   appendJson(out,s.data(),s.length());
+}
+//---------------------------------------------------------------------------
+static bool compressShard(const string& data,string& result)
+   // Compress with gzip and encode as base64
+{
+   z_stream stream;
+   memset(&stream,0,sizeof(stream));
+   if (deflateInit2(&stream,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY)!=Z_OK)
+      return false;
+   vector<unsigned char> compressed(deflateBound(&stream,data.length())+32);
+   stream.next_in=reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+   stream.avail_in=data.length();
+   stream.next_out=&compressed[0];
+   stream.avail_out=compressed.size();
+   int status=deflate(&stream,Z_FINISH);
+   unsigned long len=stream.total_out;
+   deflateEnd(&stream);
+   if (status!=Z_STREAM_END)
+      return false;
+
+   static const char digits[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   result.clear();
+   result.reserve(((len+2)/3)*4);
+   for (unsigned long index=0;index<len;index+=3) {
+      unsigned v=compressed[index]<<16;
+      if (index+1<len) v|=compressed[index+1]<<8;
+      if (index+2<len) v|=compressed[index+2];
+      result+=digits[(v>>18)&63];
+      result+=digits[(v>>12)&63];
+      result+=(index+1<len)?digits[(v>>6)&63]:'=';
+      result+=(index+2<len)?digits[v&63]:'=';
+   }
    return true;
 }
 //---------------------------------------------------------------------------
-static void removeFile(const string& dir,const string& name)
-   // Remove a file
+static bool writeShard(const string& outputDirectory,unsigned shardId,string& shard,map<string,unsigned long long>& pages,unsigned long long& written)
+   // Write a data shard of a single page report as script
 {
-   string fullName=dir+"/"+name;
-   unlink(fullName.c_str());
+   shard+="}";
+   string name=string(dataDirectory)+"/shard"+itoa(shardId)+".js",encoded;
+   PageWriter out;
+   if ((!compressShard(shard,encoded))||(!out.open(outputDirectory+"/"+name))) {
+      cerr << "unable to write " << outputDirectory << "/" << name << endl;
+      return false;
+   }
+   out << "bcovShard(" << shardId << ",\"" << encoded << "\");" << endl;
+   if (!out.close())
+      return false;
+   pages[name]=0;
+   written+=encoded.length();
+   return true;
 }
 //---------------------------------------------------------------------------
-void RunInfo::removeReport(const string& outputDirectory)
-   // Delete a written report
+bool RunInfo::writeSinglePage(const string& outputDirectory,unsigned long long maxSize)
+   // Write the report as a single page. The coverage and source of the files goes into compressed shards loaded on demand
 {
-   // Remove helper files first
-   removeFile(outputDirectory,"bcov.css");
-   removeFile(outputDirectory,"ruby.png");
-   removeFile(outputDirectory,"amber.png");
-   removeFile(outputDirectory,"emerald.png");
-   removeFile(outputDirectory,"snow.png");
-   removeFile(outputDirectory,"glass.png");
+   // Dump the helper files
+   if ((!writeCSS(outputDirectory))||(!writePNGs(outputDirectory)))
+      return false;
+   string shardDirectory=outputDirectory+"/"+dataDirectory;
+   if ((mkdir(shardDirectory.c_str(),0777)!=0)&&(errno!=EEXIST)) {
+      cerr << "unable to create " << shardDirectory << endl;
+      return false;
+   }
+   Manifest previous,pages;
+   readManifest(outputDirectory,previous);
 
-   // Remove all sub pages
-   unsigned dirCounter=0,fileCounter=0;
-   for (map<string,DirInfo>::const_iterator iter=dirs.begin(),limit=dirs.end();iter!=limit;++iter) {
-      for (unsigned files=(*iter).second.files.size();files;--files)
-         removeFile(outputDirectory,"file"+itoa(fileCounter++)+".html");
-      removeFile(outputDirectory,"dir"+itoa(dirCounter++)+".html");
+   // Write the shards, in the page order. Identical sources are stored once
+   string index="var bcovIndex={\"dirs\":[",fileIndex,shard;
+   map<pair<unsigned long,unsigned long long>,unsigned> sources;
+   unsigned long long written=0;
+   unsigned dirId=0,fileId=0,shardId=0,omitted=0;
+   unsigned totalLines=0,hitLines=0,totalStatements=0,hitStatements=0;
+   for (map<string,DirInfo>::const_iterator iter=dirs.begin(),limit=dirs.end();iter!=limit;++iter,++dirId) {
+      const DirInfo& dirInfo=(*iter).second;
+      char buffer[100];
+      if (dirId) index+=",";
+      index+="[";
+      appendJson(index,(*iter).first);
+      snprintf(buffer,sizeof(buffer),",%u,%u,%u,%u]",dirInfo.totalLines,dirInfo.hitLines,dirInfo.totalStatements,dirInfo.hitStatements);
+      index+=buffer;
+      totalLines+=dirInfo.totalLines;
+      hitLines+=dirInfo.hitLines;
+      totalStatements+=dirInfo.totalStatements;
+      hitStatements+=dirInfo.hitStatements;
+
+      for (map<string,unsigned>::const_iterator iter2=dirInfo.files.begin(),limit2=dirInfo.files.end();iter2!=limit2;++iter2,++fileId) {
+         const FileInfo& fileInfo=files[(*iter2).second];
+         if (fileId) fileIndex+=",";
+         fileIndex+="[";
+         appendJson(fileIndex,(*iter2).first);
+         snprintf(buffer,sizeof(buffer),",%u,%u,%u,%u,%u,%u]",dirId,shardId,fileInfo.totalLines,fileInfo.hitLines,fileInfo.totalStatements,fileInfo.hitStatements);
+         fileIndex+=buffer;
+
+         // The coverage as flat array of line, possible hits, hits and armed
+         snprintf(buffer,sizeof(buffer),"%s\"%u\":{\"lines\":[",shard.empty()?"{":",",fileId);
+         shard+=buffer;
+         bool first=true;
+         for (unsigned lineNo=0;lineNo<fileInfo.lines.size();lineNo++)
+            if (fileInfo.lines[lineNo].present) {
+               const LineInfo& line=fileInfo.lines[lineNo];
+               snprintf(buffer,sizeof(buffer),"%s%u,%u,%u,%u",first?"":",",lineNo,line.hitsPossible,static_cast<unsigned>(line.hits),static_cast<unsigned>(line.armed));
+               shard+=buffer;
+               first=false;
+            }
+         shard+="]";
+
+         // The source, unless it is missing, known already or too large
+         MappedFile source;
+         if (!source.open((*iter).first+(*iter2).first)) {
+            shard+=",\"missing\":true}";
+         } else {
+            unsigned long long hash=hashStart;
+            hashBytes(hash,source.data,source.size);
+            pair<unsigned long,unsigned long long> key(source.size,hash);
+            map<pair<unsigned long,unsigned long long>,unsigned>::const_iterator known=sources.find(key);
+            if (known!=sources.end()) {
+               snprintf(buffer,sizeof(buffer),",\"sourceOf\":%u}",(*known).second);
+               shard+=buffer;
+            } else {
+               string text;
+               appendJson(text,source.data,source.size);
+               // Compressed and encoded the shard is at most 4/3 of its text
+               if (maxSize&&(written+((shard.length()+text.length())*4)/3>maxSize)) {
+                  shard+=",\"omitted\":true}";
+                  omitted++;
+               } else {
+                  shard+=",\"source\":"+text+"}";
+                  sources[key]=fileId;
+               }
+            }
+         }
+
+         // Start a new shard when the current one is large enough
+         if (shard.length()>=shardSize) {
+            if (!writeShard(outputDirectory,shardId++,shard,pages,written))
+               return false;
+            shard.clear();
+         }
+      }
    }
+   if ((!shard.empty())&&(!writeShard(outputDirectory,shardId,shard,pages,written)))
+      return false;
+   if (omitted)
+      cerr << "left out the source of " << omitted << " files to stay below " << maxSize << " bytes" << endl;
 
-   // Remove the index page
-   removeFile(outputDirectory,"index.html");
+   // The page itself
+   string outName=outputDirectory+"/index.html";
+   PageWriter out;
+   if (!out.open(outName)) {
+      cerr << "unable to write " << outName << endl;
+      return false;
+   }
+   writeHeader(out,"","<span id=\"bcovView\">directory</span>",totalLines,hitLines,totalStatements,hitStatements);
+   out << "<div id=\"bcovBody\"></div>" << endl
+       << "<script type=\"text/javascript\">" << endl
+       << index << "],\"files\":[" << fileIndex << "]};" << endl
+       << singlePageScript
+       << "</script>" << endl;
+   writeFooter(out);
+   if (!out.close())
+      return false;
+
+   for (unsigned index=0;index<sizeof(helperFiles)/sizeof(helperFiles[0]);index++)
+      pages[helperFiles[index]]=0;
+   pages["index.html"]=0;
+   return finishReport(outputDirectory,previous,pages);
+}
+//---------------------------------------------------------------------------
+void RunInfo::removeReport(const string& outputDirectory)
+   // Delete a written report, as listed in its manifest
+{
+   Manifest pages;
+   if (!readManifest(outputDirectory,pages))
+      return;
+   for (Manifest::const_iterator iter=pages.begin(),limit=pages.end();iter!=limit;++iter)
+      removeFile(outputDirectory,(*iter).first);
+   removeFile(outputDirectory,manifestName);
+   rmdir((outputDirectory+"/"+dataDirectory).c_str());
 }
 //---------------------------------------------------------------------------
 static string tempDirectory()
@@ -619,15 +1560,332 @@ static string tempDirectory()
    return string(buffer);
 }
 //---------------------------------------------------------------------------
+/// Prints the first hit timeline of a dump
+class TimelinePrinter : public DumpReader
+{
+   private:
+   /// The files of the totals
+   vector<string> files;
+   /// Reading the totals?
+   bool inTotals;
+
+   protected:
+   /// The start of a segment, the file numbers start again
+   void segment() { files.clear(); inTotals=true; }
+   /// The start of an epoch section
+   bool epoch(const string& /*name*/) { inTotals=false; return false; }
+   /// A new source file
+   bool file(const string& name) { if (inTotals) files.push_back(name); return false; }
+   /// A line of the current file
+   void line(unsigned /*lineNo*/,unsigned /*hitsPossible*/,unsigned /*hits*/,unsigned /*armed*/,const LineSlots& /*slots*/) {}
+   /// A first hit
+   void timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread) {
+      char buffer[60];
+      snprintf(buffer,sizeof(buffer),"%.3f %u ",time/1000000.0,thread);
+      cout << buffer << ((fileNo<files.size())?files[fileNo]:string("?")) << ":" << lineNo << endl;
+      entries++;
+   }
+
+   public:
+   /// Number of printed entries
+   unsigned entries;
+
+   /// Constructor
+   TimelinePrinter() : inTotals(true),entries(0) {}
+};
+//---------------------------------------------------------------------------
+/// Converts a dump into the text format
+class TextExporter : public DumpReader
+{
+   private:
+   /// The output
+   DumpWriter& out;
+
+   protected:
+   /// A header entry
+   void header(const string& name,const string& value) { out.header(name,value); }
+   /// The start of an epoch section
+   bool epoch(const string& name) { out.epoch(name); return true; }
+   /// A new source file
+   bool file(const string& name) { out.file(name); return true; }
+   /// A line of the current file
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots) { out.line(lineNo,hitsPossible,hits,armed,slots); }
+   /// A first hit
+   void timeline(unsigned fileNo,unsigned lineNo,unsigned long long time,unsigned thread) { out.timeline(fileNo,lineNo,time,thread); }
+
+   public:
+   /// Constructor
+   TextExporter(DumpWriter& out) : out(out) {}
+};
+//---------------------------------------------------------------------------
+/// Converts a dump into a foreign coverage format while it is parsed. Only the current file is kept
+class CoverageExporter : public DumpReader
+{
+   private:
+   /// The path filter
+   const string& filterPath;
+   /// The epoch filter
+   const string& epochFilter;
+   /// Reading the requested section?
+   bool inSection;
+   /// Inside a file?
+   bool inFile;
+   /// Can the format only take one record per file, i.e. a single segment?
+   bool singleSegment;
+   /// Number of segments seen
+   unsigned segments;
+
+   /// Finish the current file
+   void finishFile() { if (inFile) endFile(); inFile=false; }
+
+   protected:
+   /// The output
+   PageWriter& out;
+   /// The lines of the current file
+   unsigned fileLines,fileHitLines;
+
+   /// The start of a segment
+   void segment() { finishFile(); inSection=(epochFilter==""); segments++; }
+   /// The start of an epoch section
+   bool epoch(const string& name) { finishFile(); inSection=(name==epochFilter); foundEpoch|=inSection; return inSection; }
+   /// A new source file
+   bool file(const string& name);
+   /// A line of the current file. Lines without instrumented addresses are left out
+   void line(unsigned lineNo,unsigned hitsPossible,unsigned hits,unsigned armed,const LineSlots& slots);
+
+   /// Start a file
+   virtual void beginFile(const string& name)=0;
+   /// Write a line
+   virtual void writeLine(unsigned lineNo,bool hit)=0;
+   /// End a file
+   virtual void endFile()=0;
+
+   public:
+   /// Did we see the requested epoch?
+   bool foundEpoch;
+
+   /// Constructor
+   CoverageExporter(PageWriter& out,const string& filterPath,const string& epochFilter,bool singleSegment) : filterPath(filterPath),epochFilter(epochFilter),inSection(epochFilter==""),inFile(false),singleSegment(singleSegment),segments(0),out(out),fileLines(0),fileHitLines(0),foundEpoch(false) {}
+
+   /// Read the dumps and finish the output
+   bool exportDumps(const vector<string>& files);
+   /// Finish the output
+   virtual void finish()=0;
+};
+//---------------------------------------------------------------------------
+bool CoverageExporter::file(const string& name)
+   // A new source file. Apply the filter
+{
+   finishFile();
+   if ((!inSection)||(singleSegment&&(segments>1))||((filterPath!="")&&(name.compare(0,filterPath.length(),filterPath)!=0)))
+      return false;
+   inFile=true;
+   fileLines=fileHitLines=0;
+   beginFile(name);
+   return true;
+}
+//---------------------------------------------------------------------------
+void CoverageExporter::line(unsigned lineNo,unsigned /*hitsPossible*/,unsigned hits,unsigned armed,const LineSlots& /*slots*/)
+   // A line of the current file
+{
+   if ((!armed)&&(!hits))
+      return;
+   fileLines++;
+   if (hits) fileHitLines++;
+   writeLine(lineNo,hits);
+}
+//---------------------------------------------------------------------------
+bool CoverageExporter::exportDumps(const vector<string>& files)
+   // Read the dumps and finish the output
+{
+   // Repeated files would give repeated records
+   static const char* const mergeFirst="merge the dumps with bcov-merge or compact the dump with bcov --compact-dump first";
+   if (singleSegment&&(files.size()>1)) {
+      cerr << "this format takes a single dump, " << mergeFirst << endl;
+      return false;
+   }
+   for (vector<string>::const_iterator iter=files.begin(),limit=files.end();iter!=limit;++iter) {
+      if (!read(*iter))
+         return false;
+      finishFile();
+   }
+   if (singleSegment&&(segments>1)) {
+      cerr << files.front() << " holds " << segments << " appended runs, " << mergeFirst << endl;
+      return false;
+   }
+   if ((epochFilter!="")&&(!foundEpoch)) {
+      cerr << "no epoch " << epochFilter << " in " << files.front() << endl;
+      return false;
+   }
+   finish();
+   return true;
+}
+//---------------------------------------------------------------------------
+/// Writes lcov tracefiles
+class LcovExporter : public CoverageExporter
+{
+   protected:
+   /// Start a file
+   void beginFile(const string& name) { out << "TN:" << endl << "SF:" << name << endl; }
+   /// Write a line
+   void writeLine(unsigned lineNo,bool hit) { out << "DA:" << lineNo << (hit?",1":",0") << endl; }
+   /// End a file
+   void endFile() { out << "LF:" << fileLines << endl << "LH:" << fileHitLines << endl << "end_of_record" << endl; }
+
+   public:
+   /// Constructor
+   LcovExporter(PageWriter& out,const string& filterPath,const string& epochFilter) : CoverageExporter(out,filterPath,epochFilter,false) {}
+
+   /// Finish the output
+   void finish() {}
+};
+//---------------------------------------------------------------------------
+/// Writes Cobertura XML. The rates precede the lines, they are written as placeholders and patched.
+/// Every file must come once, appended runs and further dumps are rejected
+class CoberturaExporter : public CoverageExporter
+{
+   private:
+   /// A placeholder for the rate and line counts
+   struct Totals {
+      /// The position of the placeholder
+      unsigned long long position;
+      /// The lines
+      unsigned lines,hitLines;
+   };
+
+   /// The current package
+   string package;
+   /// The totals of all files, the current package and the current file
+   Totals all,packageTotals,fileTotals;
+
+   /// Write a placeholder for totals
+   void placeholder(Totals& totals);
+   /// Fill in the totals
+   void patch(const Totals& totals);
+   /// Close the current package
+   void endPackage();
+
+   protected:
+   /// Start a file
+   void beginFile(const string& name);
+   /// Write a line
+   void writeLine(unsigned lineNo,bool hit) { out << "            <line number=\"" << lineNo << (hit?"\" hits=\"1\" branch=\"false\"/>":"\" hits=\"0\" branch=\"false\"/>") << endl; }
+   /// End a file
+   void endFile();
+
+   public:
+   /// Constructor
+   CoberturaExporter(PageWriter& out,const string& filterPath,const string& epochFilter);
+
+   /// Finish the output
+   void finish();
+};
+//---------------------------------------------------------------------------
+CoberturaExporter::CoberturaExporter(PageWriter& out,const string& filterPath,const string& epochFilter)
+   : CoverageExporter(out,filterPath,epochFilter,true)
+   // Constructor
+{
+   packageTotals.position=fileTotals.position=0;
+   char timestamp[30];
+   snprintf(timestamp,sizeof(timestamp),"%llu",static_cast<unsigned long long>(time(0))*1000);
+   out << "<?xml version=\"1.0\" ?>" << endl
+       << "<!DOCTYPE coverage SYSTEM \"http://cobertura.sourceforge.net/xml/coverage-04.dtd\">" << endl
+       << "<coverage";
+   placeholder(all);
+   out << " branches-covered=\"0\" branches-valid=\"0\" branch-rate=\"0\" complexity=\"0\" version=\"bcov " PACKAGE_VERSION "\" timestamp=\"" << timestamp << "\">" << endl
+       << "  <packages>" << endl;
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::placeholder(Totals& totals)
+   // Write a placeholder for totals. The widths are fixed
+{
+   totals.position=out.position();
+   totals.lines=totals.hitLines=0;
+   out << " line-rate=\"0.000000\" lines-covered=\"0000000000\" lines-valid=\"0000000000\"";
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::patch(const Totals& totals)
+   // Fill in the totals
+{
+   char buffer[100];
+   unsigned len=snprintf(buffer,sizeof(buffer)," line-rate=\"%8.6f\" lines-covered=\"%010u\" lines-valid=\"%010u\"",totals.lines?(static_cast<double>(totals.hitLines)/totals.lines):1.0,totals.hitLines,totals.lines);
+   out.patch(totals.position,buffer,len);
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::beginFile(const string& name)
+   // Start a file. Consecutive files of the same directory form a package
+{
+   string dir,fileName;
+   splitFileName(name,dir,fileName);
+   if ((package!=dir)||(!packageTotals.position)) {
+      endPackage();
+      package=dir;
+      out << "    <package name=\"" << Html(dir) << "\"";
+      placeholder(packageTotals);
+      out << " branch-rate=\"0\" complexity=\"0\">" << endl
+          << "      <classes>" << endl;
+   }
+   out << "        <class name=\"" << Html(fileName) << "\" filename=\"" << Html(name) << "\"";
+   placeholder(fileTotals);
+   out << " branch-rate=\"0\" complexity=\"0\">" << endl
+       << "          <methods/>" << endl
+       << "          <lines>" << endl;
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::endFile()
+   // End a file
+{
+   out << "          </lines>" << endl
+       << "        </class>" << endl;
+   fileTotals.lines=fileLines;
+   fileTotals.hitLines=fileHitLines;
+   patch(fileTotals);
+   packageTotals.lines+=fileLines;
+   packageTotals.hitLines+=fileHitLines;
+   all.lines+=fileLines;
+   all.hitLines+=fileHitLines;
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::endPackage()
+   // Close the current package
+{
+   if (!packageTotals.position)
+      return;
+   out << "      </classes>" << endl
+       << "    </package>" << endl;
+   patch(packageTotals);
+   packageTotals.position=0;
+}
+//---------------------------------------------------------------------------
+void CoberturaExporter::finish()
+   // Finish the output
+{
+   endPackage();
+   out << "  </packages>" << endl
+       << "</coverage>" << endl;
+   patch(all);
+}
+//---------------------------------------------------------------------------
 static void showHelp(const char* argv0)
    // Show the help
 {
-   cout << "usage: " << argv0 << "[-i path] [dumpfile [output directory]]" << endl
+   cout << "usage: " << argv0 << "[-i path] [-e epoch] [-m dumpfile]... [-j threads] [--single-page [--max-size size]] [dumpfile [output directory]]" << endl
+      << "       " << argv0 << " -t [dumpfile]" << endl
+      << "       " << argv0 << " --text output [dumpfile]" << endl
+      << "       " << argv0 << " --format=lcov|cobertura [-i path] [-e epoch] [-m dumpfile]... dumpfile output" << endl
       << endl
       << "\t--help\t\tshow help and end" << endl
       << "\t--version\tshow the tool version and end" << endl
+      << "\t--text\t\twrite the dump in the text format to the given file and end" << endl
+      << "\t--format\twrite an lcov tracefile or Cobertura XML file instead of html" << endl
+      << "\t--single-page\twrite one page that loads compressed coverage data on demand" << endl
+      << "\t--max-size\tleave out source text to keep the single page data below size (k, M, G suffix)" << endl
       << endl
-      << "\t-i\t\tinclude files under given path in report (default /)" << endl;
+      << "\t-i\t\tinclude files under given path in report (default /)" << endl
+      << "\t-e\t\tonly report the coverage of the given epoch" << endl
+      << "\t-m\t\tmerge another dump into the report, can be given multiple times" << endl
+      << "\t-t\t\tprint the first hit timeline as ms, thread and line and end" << endl
+      << "\t-j\t\tnumber of threads writing the file pages (default the number of cpus)" << endl;
 }
 //---------------------------------------------------------------------------
 static void showVersion(const char* argv0)
@@ -641,7 +1899,14 @@ int main(int argc,char* argv[])
    // Parse the command line
    string inputFile=".bcovdump";
    string outputDirectory;
-   string filterPath="";
+   string filterPath="",epochFilter="";
+   bool timeline=false;
+   string textFile;
+   vector<string> mergeFiles;
+   unsigned threads=onlineCpus();
+   bool singlePage=false;
+   string format;
+   unsigned long long maxSize=0;
    int start=1;
    while (start<argc) {
       if (argv[start][0]=='-') {
@@ -659,6 +1924,52 @@ int main(int argc,char* argv[])
                path=argv[++start];
             filterPath=realpath(path,0l);
             start++;
+         } else if ((strcmp(argv[start],"--text")==0)&&(start+1<argc)) {
+            textFile=argv[++start];
+            start++;
+         } else if (strncmp(argv[start],"--format=",9)==0) {
+            format=argv[start]+9;
+            if ((format!="lcov")&&(format!="cobertura")) {
+               cerr << "unknown format " << format << endl;
+               return 1;
+            }
+            start++;
+         } else if (strcmp(argv[start],"--single-page")==0) {
+            singlePage=true;
+            start++;
+         } else if ((strcmp(argv[start],"--max-size")==0)&&(start+1<argc)) {
+            char* unit;
+            maxSize=strtoull(argv[++start],&unit,10);
+            if ((*unit=='k')||(*unit=='K')) maxSize<<=10; else
+            if ((*unit=='m')||(*unit=='M')) maxSize<<=20; else
+            if ((*unit=='g')||(*unit=='G')) maxSize<<=30;
+            start++;
+         } else if ((argv[start][1]=='e')&&(argv[start][2]||(start+1<argc))) {
+            epochFilter=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='m')&&(argv[start][2]||(start+1<argc))) {
+            mergeFiles.push_back(argv[start][2]?(argv[start]+2):argv[++start]);
+            start++;
+         } else if (argv[start][1]=='j') {
+            const char* value;
+            if (argv[start][2])
+               value=argv[start]+2;
+            else
+               value=argv[++start];
+            char* end;
+            threads=strtoul(value?value:"",&end,10);
+            if ((!value)||(end==value)||(*end)||(!threads)) {
+               cerr << "invalid thread count " << (value?value:"") << ", expected a positive number" << endl;
+               return 1;
+            }
+            start++;
+         } else if (argv[start][1]=='t') {
+            timeline=true;
+            start++;
+         } else if (((argv[start][1]=='e')||(argv[start][1]=='m'))&&(!argv[start][2])) {
+            // The argument is missing
+            showHelp(argv[0]);
+            return 1;
          } else break;
       } else break;
    }
@@ -666,10 +1977,50 @@ int main(int argc,char* argv[])
       inputFile=argv[start];
       if (argc>(start+1)) outputDirectory=argv[start+1];
    }
+   if (timeline) {
+      TimelinePrinter printer;
+      if (!printer.read(inputFile))
+         return 1;
+      if (!printer.entries) {
+         cerr << "no timeline in " << inputFile << endl;
+         return 1;
+      }
+      return 0;
+   }
+   if (textFile!="") {
+      DumpWriter out(DumpWriter::Text);
+      TextExporter exporter(out);
+      if ((!out.open(textFile))||(!exporter.read(inputFile))||(!out.close()))
+         return 1;
+      return 0;
+   }
+
+   mergeFiles.insert(mergeFiles.begin(),inputFile);
+   if (format!="") {
+      // Stream the dumps into the output file
+      if (outputDirectory=="") {
+         cerr << "--format needs an output file" << endl;
+         return 1;
+      }
+      PageWriter out;
+      if (!out.open(outputDirectory)) {
+         cerr << "unable to write " << outputDirectory << endl;
+         return 1;
+      }
+      bool done;
+      if (format=="lcov") {
+         LcovExporter exporter(out,filterPath,epochFilter);
+         done=exporter.exportDumps(mergeFiles);
+      } else {
+         CoberturaExporter exporter(out,filterPath,epochFilter);
+         done=exporter.exportDumps(mergeFiles);
+      }
+      return ((done&&out.close())?0:1);
+   }
 
    // Parse the input
    RunInfo run;
-   if (!run.read(inputFile,filterPath))
+   if (!run.read(mergeFiles,filterPath,epochFilter))
       return 1;
 
    // Generate a temporary directory if needed
@@ -680,7 +2031,11 @@ int main(int argc,char* argv[])
    }
 
    // Write the output
-   run.writeReport(outputDirectory);
+   if (singlePage) {
+      if (!run.writeSinglePage(outputDirectory,maxSize))
+         return 1;
+   } else if (!run.writeReport(outputDirectory,threads))
+      return 1;
 
    // Show using the default browser if only temporary data
    if (temp&&getenv("DISPLAY")) {
@@ -0,0 +1,336 @@
+/*
+   Copyright (C) 2007 Thomas Neumann
+
+   This program is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation version 2.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+//---------------------------------------------------------------------------
+#include "ControlSocket.hpp"
+#include "Merger.hpp"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+// Keeps the merged coverage of many dumps in memory. Dumps are added
+// through a unix domain socket as they arrive, summaries and reports are
+// produced from the merged state without reading the dumps again
+//---------------------------------------------------------------------------
+/// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t stopRequested=0;
+//---------------------------------------------------------------------------
+static void handleStop(int)
+   // Stop the server after the current client
+{
+   stopRequested=1;
+}
+//---------------------------------------------------------------------------
+/// The server state
+class Server
+{
+   private:
+   /// The merged coverage
+   Merger merger;
+   /// The dump written on shutdown, if any
+   string outputFile;
+   /// Its format
+   DumpWriter::Format format;
+   /// The report tool
+   string reportTool;
+
+   /// Summarize the files below a path
+   string summary(const string& path) const;
+   /// Run the report tool on the merged coverage
+   string report(const vector<string>& args);
+
+   public:
+   /// Constructor
+   Server(const string& outputFile,DumpWriter::Format format,const string& reportTool) : outputFile(outputFile),format(format),reportTool(reportTool) {}
+
+   /// Merge a dump. Nothing is merged if it cannot be read completely
+   bool add(const string& fileName);
+   /// Execute a command. Sets stop for shutdown
+   string execute(const string& command,bool& stop);
+   /// Write the merged dump if requested
+   bool save();
+};
+//---------------------------------------------------------------------------
+static vector<string> splitArgs(const string& s)
+   // Split at blanks
+{
+   vector<string> result;
+   istringstream in(s);
+   string arg;
+   while (in >> arg)
+      result.push_back(arg);
+   return result;
+}
+//---------------------------------------------------------------------------
+bool Server::add(const string& fileName)
+   // Merge a dump. It is read into a scratch merger first, a corrupt dump leaves the merged coverage alone
+{
+   Merger scratch;
+   if (!scratch.merge(fileName))
+      return false;
+   merger.merge(scratch);
+   return true;
+}
+//---------------------------------------------------------------------------
+string Server::summary(const string& path) const
+   // Summarize the files below a path
+{
+   unsigned files=0,totalLines=0,hitLines=0;
+   for (Coverage::const_iterator iter=merger.totals.lower_bound(path),limit=merger.totals.end();iter!=limit;++iter) {
+      if ((*iter).first.compare(0,path.length(),path)!=0)
+         break;
+      if ((*iter).second.lines.empty())
+         continue;
+      files++;
+      totalLines+=(*iter).second.lines.size();
+      hitLines+=(*iter).second.hitLines();
+   }
+   char buffer[200];
+   snprintf(buffer,sizeof(buffer),"ok %u dumps, %u files, %u of %u lines hit",merger.inputs,files,hitLines,totalLines);
+   return buffer;
+}
+//---------------------------------------------------------------------------
+string Server::report(const vector<string>& args)
+   // Run the report tool on the merged coverage. The last argument is the output
+{
+   if (args.size()<2)
+      return "error report needs an output";
+   char dumpFile[]="/tmp/bcov-server.XXXXXX";
+   int fd=mkstemp(dumpFile);
+   if (fd<0)
+      return string("error ")+strerror(errno);
+   close(fd);
+   if (!merger.write(dumpFile,DumpWriter::Binary)) {
+      unlink(dumpFile);
+      return "error unable to write the merged dump";
+   }
+
+   // bcov-report [options] dump output
+   vector<char*> argv;
+   argv.push_back(const_cast<char*>(reportTool.c_str()));
+   for (unsigned index=1;index+1<args.size();index++)
+      argv.push_back(const_cast<char*>(args[index].c_str()));
+   argv.push_back(dumpFile);
+   argv.push_back(const_cast<char*>(args.back().c_str()));
+   argv.push_back(0);
+   pid_t child=fork();
+   if (!child) {
+      execvp(argv[0],&argv[0]);
+      perror(argv[0]);
+      _exit(127);
+   }
+   int status=0;
+   bool ok=(child>0);
+   if (ok) {
+      while ((waitpid(child,&status,0)<0)&&(errno==EINTR)) ;
+      ok=WIFEXITED(status)&&(WEXITSTATUS(status)==0);
+   }
+   unlink(dumpFile);
+   return ok?"ok":"error "+reportTool+" failed";
+}
+//---------------------------------------------------------------------------
+string Server::execute(const string& command,bool& stop)
+   // Execute a command
+{
+   vector<string> args=splitArgs(command);
+   if (args.empty())
+      return "error empty command";
+   const string& name=args[0];
+   if (name=="add") {
+      if (args.size()!=2)
+         return "error add needs a dump";
+      if (!add(args[1]))
+         return "error unable to read "+args[1];
+      return "ok";
+   } else if (name=="summary") {
+      if (args.size()>2)
+         return "error summary takes at most a path";
+      return summary((args.size()>1)?args[1]:"");
+   } else if (name=="write") {
+      if ((args.size()<2)||(args.size()>3)||((args.size()==3)&&(args[2]!="text")))
+         return "error write needs a file and optionally text";
+      if (!merger.write(args[1],(args.size()==3)?DumpWriter::Text:DumpWriter::Binary))
+         return "error unable to write "+args[1];
+      return "ok";
+   } else if (name=="report") {
+      return report(args);
+   } else if (name=="reset") {
+      merger.clear();
+      return "ok";
+   } else if (name=="shutdown") {
+      stop=true;
+      return save()?"ok":"error unable to write "+outputFile;
+   }
+   return "error unknown command "+name;
+}
+//---------------------------------------------------------------------------
+bool Server::save()
+   // Write the merged dump if requested
+{
+   if (outputFile=="")
+      return true;
+   return merger.write(outputFile,format);
+}
+//---------------------------------------------------------------------------
+static string defaultReportTool()
+   // bcov-report next to the server, or from the path
+{
+   char buffer[4096];
+   ssize_t len=readlink("/proc/self/exe",buffer,sizeof(buffer)-1);
+   if (len>0) {
+      string self(buffer,len);
+      string tool=self.substr(0,self.rfind('/')+1)+"bcov-report";
+      if (access(tool.c_str(),X_OK)==0)
+         return tool;
+   }
+   return "bcov-report";
+}
+//---------------------------------------------------------------------------
+static void showHelp(const char* argv0)
+   // Show the help
+{
+   cout << "usage: " << argv0 << " [-s socket] [-o output] [--text] [-r bcov-report] [dumpfile(s)]" << endl
+      << "       " << argv0 << " -c socket command" << endl
+      << endl
+      << "\t--help\t\tshow help and end" << endl
+      << "\t--version\tshow the tool version and end" << endl
+      << "\t--text\t\twrite the text format instead of the binary one" << endl
+      << endl
+      << "\t-s\t\tthe socket to listen on (default .bcov-server)" << endl
+      << "\t-o\t\twrite the merged dump on shutdown" << endl
+      << "\t-r\t\tthe report tool (default bcov-report next to the server)" << endl
+      << "\t-c\t\tsend a command to a running server and print the reply" << endl
+      << endl
+      << "commands:" << endl
+      << "\tadd <dump>\t\t\tmerge a dump" << endl
+      << "\tsummary [path]\t\t\tlines hit in the files below path" << endl
+      << "\twrite <file> [text]\t\twrite the merged dump" << endl
+      << "\treport [options] <output>\trun bcov-report with the options on the merged dump" << endl
+      << "\treset\t\t\t\tforget all dumps" << endl
+      << "\tshutdown\t\t\twrite the output and end" << endl;
+}
+//---------------------------------------------------------------------------
+static void showVersion(const char* argv0)
+   // Show the help
+{
+   cout << argv0 << " " << PACKAGE_VERSION " from package " << PACKAGE_TARNAME << endl;
+}
+//---------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+   // Parse the command line
+   string socketPath=".bcov-server",outputFile,reportTool=defaultReportTool(),clientSocket;
+   DumpWriter::Format format=DumpWriter::Binary;
+   vector<string> inputs;
+   int start=1;
+   while (start<argc) {
+      if (argv[start][0]=='-') {
+         if (strcmp(argv[start],"--help")==0) {
+            showHelp(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--version")==0) {
+            showVersion(argv[0]);
+            return 1;
+         } else if (strcmp(argv[start],"--text")==0) {
+            format=DumpWriter::Text;
+            start++;
+         } else if ((argv[start][1]=='s')&&(argv[start][2]||(start+1<argc))) {
+            socketPath=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='o')&&(argv[start][2]||(start+1<argc))) {
+            outputFile=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='r')&&(argv[start][2]||(start+1<argc))) {
+            reportTool=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+         } else if ((argv[start][1]=='c')&&(argv[start][2]||(start+1<argc))) {
+            clientSocket=argv[start][2]?(argv[start]+2):argv[++start];
+            start++;
+            break;
+         } else {
+            showHelp(argv[0]);
+            return 1;
+         }
+      } else inputs.push_back(argv[start++]);
+   }
+
+   // Send a command to a running server
+   if (clientSocket!="") {
+      string command;
+      for (;start<argc;start++)
+         command+=(command.empty()?"":" ")+string(argv[start]);
+      if (command=="") {
+         showHelp(argv[0]);
+         return 1;
+      }
+      vector<string> commands(1,command),replies;
+      if (!ControlSocket::request(clientSocket,commands,replies))
+         return 1;
+      bool ok=!replies.empty();
+      for (vector<string>::const_iterator iter=replies.begin(),limit=replies.end();iter!=limit;++iter) {
+         cout << (*iter) << endl;
+         ok&=((*iter).compare(0,2,"ok")==0);
+      }
+      return ok?0:1;
+   }
+
+   // Start with the given dumps, e.g. the output of an earlier run
+   Server server(outputFile,format,reportTool);
+   for (vector<string>::const_iterator iter=inputs.begin(),limit=inputs.end();iter!=limit;++iter)
+      if (!server.add(*iter))
+         return 1;
+
+   ControlSocket control;
+   if (!control.open(socketPath))
+      return 1;
+   struct sigaction action;
+   memset(&action,0,sizeof(action));
+   action.sa_handler=handleStop;
+   sigaction(SIGINT,&action,0);
+   sigaction(SIGTERM,&action,0);
+   cerr << "listening on " << socketPath << endl;
+
+   // Serve the clients one after the other
+   bool stop=false;
+   while ((!stop)&&(!stopRequested)) {
+      vector<string> commands;
+      int client=control.receive(commands);
+      if (client<0) {
+         if (errno==EINTR)
+            continue;
+         perror("accept");
+         break;
+      }
+      for (vector<string>::const_iterator iter=commands.begin(),limit=commands.end();iter!=limit;++iter)
+         ControlSocket::reply(client,stop?"error shutting down":server.execute(*iter,stop));
+      ControlSocket::finish(client);
+   }
+   control.close();
+   if ((!stop)&&(!server.save())) {
+      cerr << "unable to write " << outputFile << endl;
+      return 1;
+   }
+   return 0;
+}
+//---------------------------------------------------------------------------